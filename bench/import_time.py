@@ -0,0 +1,46 @@
+#!/usr/bin/python3
+# Measure the time to parse and register the dialects of a spec file, and the
+# time to then touch a given number of the generated op classes.
+#
+# Usage: PYTHONPATH=$BINDIR/lib/Python python3 import_time.py [spec] [numOps]
+import os
+import sys
+import time
+
+start = time.perf_counter()
+from mlir import *
+importTime = time.perf_counter() - start
+
+cwd = os.path.dirname(os.path.realpath(__file__))
+
+def main():
+    filename = sys.argv[1] if len(sys.argv) > 1 else cwd + '/../lua/lua.mlir'
+    numOps = int(sys.argv[2]) if len(sys.argv) > 2 else 5
+
+    start = time.perf_counter()
+    m = parseSourceFile(filename)
+    assert m, "failed to load dialects"
+    parseTime = time.perf_counter() - start
+
+    start = time.perf_counter()
+    dialects = registerDynamicDialects(m)
+    registerTime = time.perf_counter() - start
+
+    start = time.perf_counter()
+    touched = 0
+    for dialect in dialects:
+        for name in dir(dialect):
+            if touched == numOps:
+                break
+            cls = getattr(dialect, name)
+            if isinstance(cls, type) and hasattr(cls, 'getName'):
+                touched += 1
+    touchTime = time.perf_counter() - start
+
+    print("import mlir:        {:8.2f} ms".format(importTime * 1e3))
+    print("parse spec:         {:8.2f} ms".format(parseTime * 1e3))
+    print("register dialects:  {:8.2f} ms".format(registerTime * 1e3))
+    print("touch {:3} classes:  {:8.2f} ms".format(touched, touchTime * 1e3))
+
+if __name__ == '__main__':
+    main()
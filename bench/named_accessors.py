@@ -0,0 +1,57 @@
+#!/usr/bin/python3
+# Microbenchmark: access named operands and results of dynamic ops from
+# Python, through the generated getters and through OperationWrap by name.
+#
+# Usage: PYTHONPATH=$BINDIR/lib/Python python3 named_accessors.py [numOps] [reps]
+import os
+import sys
+import time
+
+from mlir import *
+
+cwd = os.path.dirname(os.path.realpath(__file__))
+
+def get_dialects(filename=cwd + '/../lua/lua.mlir'):
+    m = parseSourceFile(filename)
+    assert m, "failed to load dialects"
+    return registerDynamicDialects(m)
+
+def timeit(name, fcn, numCalls, reps):
+    best = float('inf')
+    for _ in range(reps):
+        start = time.perf_counter()
+        fcn()
+        best = min(best, time.perf_counter() - start)
+    print("{:24} {:8.3f} ms, {:6.1f} ns/access"
+          .format(name, best * 1e3, best * 1e9 / numCalls))
+
+def main():
+    numOps = int(sys.argv[1]) if len(sys.argv) > 1 else 10000
+    reps = int(sys.argv[2]) if len(sys.argv) > 2 else 20
+    lua = get_dialects()[0]
+
+    m = ModuleOp()
+    func = FuncOp("bench", FunctionType([], []))
+    m.append(func)
+    b = Builder()
+    b.insertAtStart(func.addEntryBlock())
+    val = b.create(lua.nil, loc=UnknownLoc()).res()
+    ops = [b.create(lua.binary, lhs=val, rhs=val, op=StringAttr("+"),
+                    loc=UnknownLoc()) for _ in range(numOps)]
+    b.create(ReturnOp, operands=[])
+
+    def generated():
+        for op in ops:
+            op.lhs(); op.rhs(); op.res()
+    def byName():
+        for op in ops:
+            OperationWrap.getOperand(op, "lhs")
+            OperationWrap.getOperand(op, "rhs")
+            OperationWrap.getResult(op, "res")
+
+    numCalls = 3 * numOps
+    timeit("generated getters", generated, numCalls, reps)
+    timeit("OperationWrap by name", byName, numCalls, reps)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,68 @@
+#!/usr/bin/python3
+# Microbenchmark: iterate the operand types of every operation in a large
+# function. Each type returned to Python goes through the polymorphic type
+# hook, so this measures the cost of downcasting Type to its concrete class.
+#
+# Usage: PYTHONPATH=$BINDIR/lib/Python python3 operand_types.py [numOps] [reps]
+import os
+import sys
+import tempfile
+import time
+
+from mlir import *
+
+cwd = os.path.dirname(os.path.realpath(__file__))
+
+def get_dialects(filename=cwd + '/../lua/lua.mlir'):
+    m = parseSourceFile(filename)
+    assert m, "failed to load dialects"
+    return registerDynamicDialects(m)
+
+def make_module(numOps):
+    # lua.binary only takes !lua.val, so the builtin-typed operands go
+    # through std arithmetic ops instead.
+    lines = ["func @bench(%i: i64, %f: f64, %t: tensor<4xf64>) {",
+             "  %v0 = \"lua.nil\"() : () -> !lua.val"]
+    last = 0
+    for i in range(1, numOps):
+        if i % 4 == 0:
+            lines.append("  %i{} = addi %i, %i : i64".format(i))
+        elif i % 4 == 1:
+            lines.append("  %t{} = addf %t, %t : tensor<4xf64>".format(i))
+        elif i % 4 == 2:
+            lines.append("  %f{} = addf %f, %f : f64".format(i))
+        else:
+            lines.append("  %v{} = \"lua.binary\"(%v{}, %v{}) {{op = \"+\"}} : "
+                         "(!lua.val, !lua.val) -> !lua.val"
+                         .format(i, last, last))
+            last = i
+    lines += ["  return", "}"]
+    with tempfile.NamedTemporaryFile('w', suffix='.mlir', delete=False) as f:
+        f.write('\n'.join(lines))
+        return f.name
+
+def main():
+    numOps = int(sys.argv[1]) if len(sys.argv) > 1 else 10000
+    reps = int(sys.argv[2]) if len(sys.argv) > 2 else 20
+    get_dialects()
+    filename = make_module(numOps)
+    module = parseSourceFile(filename)
+    os.remove(filename)
+    assert module, "failed to parse benchmark module"
+
+    ops = []
+    walkOperations(module, lambda op: ops.append(op))
+    numTypes = sum(len(list(op.getOperandTypes())) for op in ops)
+
+    best = float('inf')
+    for _ in range(reps):
+        start = time.perf_counter()
+        for op in ops:
+            for ty in op.getOperandTypes():
+                pass
+        best = min(best, time.perf_counter() - start)
+    print("operand types: {}, best of {}: {:.3f} ms, {:.1f} ns/type"
+          .format(numTypes, reps, best * 1e3, best * 1e9 / numTypes))
+
+if __name__ == '__main__':
+    main()
@@ -26,6 +26,12 @@ public:
   }
 };
 
+/// The operand and result group indices of a named value. A name may refer to
+/// both an operand and a result.
+struct NamedValueIndex {
+  llvm::Optional<unsigned> operand, result;
+};
+
 /// This class dynamically captures properties of an Operation.
 class DynamicOperation : public DynamicObject {
 public:
@@ -72,6 +78,11 @@ public:
   template <typename TraitT> TraitT *getTrait();
   DynamicTrait *getTrait(llvm::StringRef);
 
+  /// Lookup the operand and result group indices of a named value. Returns
+  /// null if no operand or result has the name. The table is built when the
+  /// operation is finalized.
+  const NamedValueIndex *lookupNamedValue(llvm::StringRef name) const;
+
   /// Parse or print an operation.
   mlir::ParseResult parseOperation(mlir::OpAsmParser &parser,
                                    mlir::OperationState &result);
@@ -91,6 +102,9 @@ private:
   /// The function names of the custom parser and printers, if present.
   llvm::Optional<std::string> parserFcn, printerFcn;
 
+  /// Named operand and result groups.
+  llvm::StringMap<NamedValueIndex> namedValues;
+
   // Operation info
   const mlir::AbstractOperation *opInfo;
 };
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+
+namespace pybind11 {
+class object;
+}
+
+namespace dmc {
+namespace py {
+
+/// Generated Python code (parsers, printers, classes, and constraints) is
+/// compiled once and its code object is stored on disk, in a `__pycache__`
+/// directory under the cache prefix. The file is keyed by a hash of the source
+/// and the DMC version, and tagged with the interpreter's cache tag.
+///
+/// The prefix is read from `DMC_PYCACHE_PREFIX`, falling back to the user
+/// cache directory. An empty prefix disables the cache.
+struct CodeCacheStats {
+  unsigned hits{};
+  unsigned misses{};
+  unsigned errors{};
+};
+
+/// Execute generated Python source in the given scope, loading the compiled
+/// code from the cache if possible.
+void execCached(const std::string &source, pybind11::object scope);
+
+/// Cache location and statistics.
+void setCodeCacheDir(std::string dir);
+const std::string &getCodeCacheDir();
+const CodeCacheStats &getCodeCacheStats();
+
+} // end namespace py
+} // end namespace dmc
@@ -35,6 +35,10 @@ public:
       pybind11::module &m);
   ~InMemoryClass();
 
+  /// Get the Python name of a class declared as `clsName`. Names that are
+  /// Python keywords are capitalized.
+  static std::string getClassName(llvm::StringRef clsName);
+
 private:
   pybind11::module &m;
 };
@@ -1,8 +1,19 @@
 #pragma once
 
+#include <functional>
+
 namespace mlir {
 class MLIRContext;
 namespace py {
+/// Set the context used by Python. The interpreter is not started until
+/// Python is needed, so that specs without Python constraints, formats, or
+/// traits never pay for interpreter start-up.
 void init(MLIRContext *ctx);
+/// Start the interpreter, if it has not been started, and run any deferred
+/// Python initialization.
+void ensureInit();
+/// Run a function once the interpreter has started, or immediately if it
+/// already has.
+void onInit(std::function<void()> fcn);
 } // end namespace py
 } // end namespace mlir
@@ -18,16 +18,27 @@ public:
   auto *getOp() { return op; }
   auto *getSpec() { return spec; }
 
-  mlir::Value getOperand(std::string name);
-  mlir::Value getResult(std::string name);
-  mlir::ValueRange getOperandGroup(std::string name);
-  mlir::ValueRange getResultGroup(std::string name);
+  /// Lookup named operand and result groups. Throws if the op has no value
+  /// with the name.
+  mlir::Value getOperand(llvm::StringRef name);
+  mlir::Value getResult(llvm::StringRef name);
+  mlir::ValueRange getOperandGroup(llvm::StringRef name);
+  mlir::ValueRange getResultGroup(llvm::StringRef name);
   mlir::Region &getRegion(std::string name);
 
+  /// Get operand and result groups by their index in the op type.
+  mlir::Value getOperand(unsigned idx);
+  mlir::Value getResult(unsigned idx);
+  mlir::ValueRange getOperandGroup(unsigned idx);
+  mlir::ValueRange getResultGroup(unsigned idx);
+
   mlir::Value getOperandOrResult(llvm::StringRef name);
   mlir::ValueRange getOperandOrResultGroup(llvm::StringRef name);
 
 private:
+  void checkOperandIdx(unsigned idx);
+  void checkResultIdx(unsigned idx);
+
   mlir::Operation *op;
   DynamicOperation *spec;
   TypeConstraintTrait *type;
@@ -14,6 +14,7 @@
 #include <mlir/IR/Operation.h>
 
 #include <mlir/Dialect/StandardOps/IR/Ops.h>
+#include <llvm/ADT/DenseMap.h>
 
 /// Shorthand for declaring polymorphic type hooks for MLIR-style RTTI.
 namespace detail {
@@ -47,9 +48,48 @@ struct polymorphic_type_hooks_impl<BaseT, DerivedT, DerivedTs...> {
   }
 };
 
+/// Memoize the result of the `isa<>` chain by object kind. Each hook
+/// instantiation owns a table from kind to the `type_info` of the first
+/// matching derived class, or null if none matched. Entries are filled on the
+/// first query of a kind, so dynamically allocated kinds are picked up too.
+/// All accesses happen with the GIL held.
+template <typename BaseT, typename... DerivedTs>
+struct polymorphic_kind_table {
+  static const std::type_info *lookup(const BaseT *src) {
+    static llvm::DenseMap<unsigned, const std::type_info *> table;
+    auto kind = static_cast<unsigned>(src->getKind());
+    auto it = table.find(kind);
+    if (it != table.end())
+      return it->second;
+    const std::type_info *derived = nullptr;
+    polymorphic_type_hooks_impl<BaseT, DerivedTs...>::get(src, derived);
+    return table.try_emplace(kind, derived).first->second;
+  }
+};
+
 } // end namespace detail
 
+/// Downcast hooks for classes whose `classof` depends only on the kind of the
+/// object. The downcast is a single table lookup.
 template <typename BaseT, typename... DerivedTs> struct polymorphic_type_hooks {
+  static const void *get(const BaseT *src, const std::type_info *&type) {
+    if (!src || !*src)
+      return src;
+    auto *derived = detail::polymorphic_kind_table<BaseT, DerivedTs...>
+          ::lookup(src);
+    if (!derived)
+      return nullptr;
+    type = derived;
+    // See the note in polymorphic_type_hooks_impl about this cast.
+    return src;
+  }
+};
+
+/// Downcast hooks for classes whose `classof` inspects more than the kind,
+/// e.g. the element type of a dense elements attribute. These walk the
+/// `isa<>` chain on every query.
+template <typename BaseT, typename... DerivedTs>
+struct polymorphic_type_hooks_uncached {
   static const void *get(const BaseT *src, const std::type_info *&type) {
     if (!src || !*src)
       return src;
@@ -92,8 +132,10 @@ template <> struct polymorphic_type_hook<Attribute>
       DenseIntOrFPElementsAttr, DenseFPElementsAttr,
       DenseIntElementsAttr> {};
 
+/// DenseFPElementsAttr and DenseIntElementsAttr share a kind and are
+/// distinguished by element type.
 template <> struct polymorphic_type_hook<DenseIntOrFPElementsAttr>
-    : public polymorphic_type_hooks<DenseIntOrFPElementsAttr,
+    : public polymorphic_type_hooks_uncached<DenseIntOrFPElementsAttr,
       DenseFPElementsAttr, DenseIntElementsAttr> {};
 
 template <> struct polymorphic_type_hook<DenseElementsAttr>
@@ -36,7 +36,7 @@ DynamicContext::DynamicContext(MLIRContext *ctx)
     : Dialect{getDialectNamespace(), ctx, TypeID::get<DynamicContext>()},
       typeIdAlloc{getFixedTypeIDAllocator()},
       impl{std::make_unique<Impl>()} {
-  // Automatically initialize the interpreter
+  // The interpreter is started lazily, the first time Python is needed.
   py::init(ctx);
 }
 
@@ -101,9 +101,28 @@ LogicalResult DynamicOperation::finalize() {
   /// Take reference to the operation info.
   opInfo = AbstractOperation::lookup(name, dialect->getContext());
   assert(opInfo != nullptr && "Failed to add DynamicOperation");
+  /// Index the named operand and result groups.
+  if (auto *type = getTrait<TypeConstraintTrait>()) {
+    auto opType = type->getOpType();
+    for (unsigned idx = 0, e = opType.getNumOperands(); idx < e; ++idx) {
+      auto &index = namedValues[opType.getOperandName(idx)];
+      if (!index.operand)
+        index.operand = idx;
+    }
+    for (unsigned idx = 0, e = opType.getNumResults(); idx < e; ++idx) {
+      auto &index = namedValues[opType.getResultName(idx)];
+      if (!index.result)
+        index.result = idx;
+    }
+  }
   return success();
 }
 
+const NamedValueIndex *DynamicOperation::lookupNamedValue(StringRef name) const {
+  auto it = namedValues.find(name);
+  return it == std::end(namedValues) ? nullptr : &it->second;
+}
+
 LogicalResult DynamicOperation::verifyOpTraits(Operation *op) const {
   for (const auto &trait : traits) {
     if (failed(trait.second->verifyOp(op))) {
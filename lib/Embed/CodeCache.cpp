@@ -0,0 +1,153 @@
+#include "dmc/Embed/CodeCache.h"
+
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/SHA1.h>
+#include <llvm/Support/raw_ostream.h>
+#include <pybind11/pybind11.h>
+
+using namespace llvm;
+using namespace pybind11;
+
+namespace dmc {
+namespace py {
+
+namespace {
+class CodeCache {
+public:
+  static CodeCache &get() {
+    static CodeCache instance;
+    return instance;
+  }
+
+  void exec(const std::string &source, object scope) {
+    auto builtins = module::import("builtins");
+    if (dir.empty()) {
+      builtins.attr("exec")(source, scope);
+      return;
+    }
+    auto path = getPath(source);
+    if (auto code = load(path)) {
+      ++stats.hits;
+      builtins.attr("exec")(code, scope);
+      return;
+    }
+    ++stats.misses;
+    auto code = builtins.attr("compile")(source, "<string>", "exec");
+    store(path, code);
+    builtins.attr("exec")(code, scope);
+  }
+
+  std::string dir;
+  CodeCacheStats stats;
+
+private:
+  CodeCache() {
+    if (auto prefix = sys::Process::GetEnv("DMC_PYCACHE_PREFIX")) {
+      dir = *prefix;
+    } else {
+      SmallString<128> path;
+      if (sys::path::cache_directory(path)) {
+        sys::path::append(path, "dmc");
+        dir = path.str().str();
+      }
+    }
+  }
+
+  std::string getPath(const std::string &source) {
+    std::string key{DMC_VERSION};
+    key.push_back('\0');
+    key += source;
+    auto hash = SHA1::hash(arrayRefFromStringRef(key));
+    auto tag = module::import("sys").attr("implementation").attr("cache_tag")
+        .cast<std::string>();
+    SmallString<128> path{dir};
+    sys::path::append(path, "__pycache__",
+                      toHex(hash, /*LowerCase=*/true) + "." + tag + ".pyc");
+    return path.str().str();
+  }
+
+  /// Files begin with the interpreter's bytecode magic number, followed by the
+  /// marshalled code object.
+  Optional<object> load(const std::string &path) {
+    auto buf = MemoryBuffer::getFile(path);
+    if (!buf)
+      return llvm::None;
+    auto data = (*buf)->getBuffer();
+    auto magic = getMagic();
+    if (!data.startswith(magic))
+      return llvm::None;
+    data = data.drop_front(magic.size());
+    try {
+      return module::import("marshal").attr("loads")(
+          bytes{data.data(), data.size()});
+    } catch (const error_already_set &) {
+      ++stats.errors;
+      return llvm::None;
+    }
+  }
+
+  /// Write to a temporary file and rename it so that concurrent processes
+  /// never observe a partial file. Failures only cost a recompile.
+  void store(const std::string &path, object code) {
+    if (sys::fs::create_directories(sys::path::parent_path(path))) {
+      ++stats.errors;
+      return;
+    }
+    auto data = module::import("marshal").attr("dumps")(code)
+        .cast<std::string>();
+    int fd;
+    SmallString<128> tmpPath;
+    if (sys::fs::createUniqueFile(path + "-%%%%%%", fd, tmpPath)) {
+      ++stats.errors;
+      return;
+    }
+    {
+      raw_fd_ostream os{fd, /*shouldClose=*/true};
+      os << getMagic() << data;
+      if (os.has_error()) {
+        os.clear_error();
+        sys::fs::remove(tmpPath);
+        ++stats.errors;
+        return;
+      }
+    }
+    if (sys::fs::rename(tmpPath, path)) {
+      sys::fs::remove(tmpPath);
+      ++stats.errors;
+    }
+  }
+
+  std::string getMagic() {
+    if (magic.empty()) {
+      magic = module::import("importlib.util").attr("MAGIC_NUMBER")
+          .cast<std::string>();
+    }
+    return magic;
+  }
+
+  std::string magic;
+};
+} // end anonymous namespace
+
+void execCached(const std::string &source, object scope) {
+  CodeCache::get().exec(source, scope);
+}
+
+void setCodeCacheDir(std::string dir) {
+  CodeCache::get().dir = std::move(dir);
+}
+
+const std::string &getCodeCacheDir() {
+  return CodeCache::get().dir;
+}
+
+const CodeCacheStats &getCodeCacheStats() {
+  return CodeCache::get().stats;
+}
+
+} // end namespace py
+} // end namespace dmc
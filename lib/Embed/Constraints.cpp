@@ -1,5 +1,7 @@
 #include "Scope.h"
 #include "dmc/Embed/Constraints.h"
+#include "dmc/Embed/CodeCache.h"
+#include "dmc/Embed/Init.h"
 #include "dmc/Traits/StandardTraits.h"
 #include "dmc/Dynamic/DynamicOperation.h"
 
@@ -27,6 +29,7 @@ public:
 
   /// Function registers a constraint and returns the name. Throws on error.
   std::string registerConstraint(std::string expr) {
+    mlir::py::ensureInit();
     // Substitute `{self}`
     dict fmtArgs{"self"_a = "arg"};
     auto pyExpr = pybind11::cast(expr).cast<str>().format(**fmtArgs);
@@ -36,7 +39,7 @@ public:
     dict funcExpr{"func_name"_a = funcName, "expr"_a = pyExpr};
     auto funcStr = "def {func_name}(arg): return {expr}"_s
         .format(**funcExpr);
-    exec(funcStr, getInternalScope());
+    execCached(funcStr.cast<std::string>(), getInternalScope());
     return funcName;
   }
 
@@ -80,11 +83,13 @@ Region &LoopLike::getLoopRegion(DynamicOperation *impl, Operation *op) {
 
 bool LoopLike::isDefinedOutside(DynamicOperation *impl, Operation *op,
                                 Value value) {
+  mlir::py::ensureInit();
   return !getLoopRegion(impl, op).isAncestor(value.getParentRegion()) &&
       py::getMainScope()[definedOutsideFcn.str().c_str()](op, value).cast<bool>();
 }
 
 bool LoopLike::canBeHoisted(DynamicOperation *impl, Operation *op) {
+  mlir::py::ensureInit();
   return py::getMainScope()[canBeHoistedFcn.str().c_str()](op).cast<bool>();
 }
 
@@ -13,6 +13,7 @@
 #include "dmc/Python/Polymorphic.h"
 
 #include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/StringMap.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/embed.h>
 
@@ -201,18 +202,21 @@ void exposeDynamicOp(module &m, DynamicOperation *impl) {
   s.def("getName()"); {
     s.line() << "return \"" << impl->getName() << "\"";
   } s.enddef();
-  for (auto &[name, type] : opType.getOperands()) {
-    auto getter = type.isa<VariadicType>() ? "getOperandGroup" : "getOperand";
-    s.def(name + "(self)"); {
-      s.line() << "return mlir.OperationWrap." << getter << "(self, \"" << name
-        << "\")";
+  // Operand and result getters bind directly to the group index.
+  for (auto operand : llvm::enumerate(opType.getOperands())) {
+    auto getter = operand.value().type.isa<VariadicType>() ?
+        "getOperandGroupAt" : "getOperandAt";
+    s.def(operand.value().name + "(self)"); {
+      s.line() << "return mlir.OperationWrap." << getter << "(self, "
+          << operand.index() << ")";
     } s.enddef();
   }
-  for (auto &[name, type] : opType.getResults()) {
-    auto getter = type.isa<VariadicType>() ? "getResultGroup" : "getResult";
-    s.def(name + "(self)"); {
-      s.line() << "return mlir.OperationWrap." << getter << "(self, \"" << name
-          << "\")";
+  for (auto result : llvm::enumerate(opType.getResults())) {
+    auto getter = result.value().type.isa<VariadicType>() ?
+        "getResultGroupAt" : "getResultAt";
+    s.def(result.value().name + "(self)"); {
+      s.line() << "return mlir.OperationWrap." << getter << "(self, "
+          << result.index() << ")";
     } s.enddef();
   }
   for (auto &[name, attr] : opAttr) {
@@ -255,12 +259,40 @@ void exposeDialectInternal(DynamicDialect *dialect, ArrayRef<StringRef> scope) {
     exec(name.str() + " = mlir.register_internal_module_" +
          name.str() + "()", m.attr("__dict__"));
   }
+  // Generating and executing the Python classes is a large part of dialect
+  // registration, so classes are only generated on first access through the
+  // module `__getattr__`. Once executed, a class lives in the module dict and
+  // is found without calling `__getattr__` again.
+  auto lazyClasses = std::make_shared<StringMap<std::function<void()>>>();
   for (auto *ty : dialect->getTypes()) {
-    exposeDynamicType(m, ty);
+    (*lazyClasses)[InMemoryClass::getClassName(ty->getName())] =
+        [m, ty]() mutable { exposeDynamicType(m, ty); };
   }
   for (auto *op : dialect->getOps()) {
-    exposeDynamicOp(m, op);
+    auto opName = op->getName();
+    (*lazyClasses)[InMemoryClass::getClassName(sanitizeClassName(
+        opName.substr(opName.find('.') + 1)))] =
+        [m, op]() mutable { exposeDynamicOp(m, op); };
   }
+  m.def("__getattr__", [m, lazyClasses](std::string name) -> object {
+    auto it = lazyClasses->find(name);
+    if (it == lazyClasses->end())
+      throw attribute_error{"module '" + m.attr("__name__").cast<std::string>() +
+                            "' has no attribute '" + name + "'"};
+    // Remove the entry before generating the class so that the generator is
+    // released once the class is in the module dict.
+    auto generate = std::move(it->second);
+    lazyClasses->erase(it);
+    generate();
+    return m.attr("__dict__")[name.c_str()];
+  });
+  m.def("__dir__", [m, lazyClasses]() {
+    auto names = m.attr("__dict__").cast<dict>().attr("keys")()
+        .cast<std::vector<std::string>>();
+    for (auto &entry : *lazyClasses)
+      names.push_back(entry.getKey().str());
+    return names;
+  });
   for (auto *ty : dialect->getTypeAliases()) {
     auto name = ty->getName().str();
     m.def(name.c_str(), [ty]() { return ty->getAliasedType(); });
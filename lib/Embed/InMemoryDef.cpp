@@ -1,8 +1,10 @@
 #include "Scope.h"
 #include "dmc/Embed/InMemoryDef.h"
+#include "dmc/Embed/CodeCache.h"
+#include "dmc/Embed/Init.h"
 
 #include <llvm/ADT/StringSwitch.h>
-#include <pybind11/embed.h>
+#include <pybind11/pybind11.h>
 
 using namespace llvm;
 using namespace pybind11;
@@ -16,12 +18,13 @@ InMemoryDef::InMemoryDef(StringRef fcnName, StringRef fcnSig) {
 
 InMemoryDef::~InMemoryDef() {
   pgs.enddef();
-  // Store the parser/printer in the internal scope
-  exec(os.str(), getInternalScope());
+  // Store the parser/printer in the internal scope once Python is needed.
+  mlir::py::onInit([source{os.str()}]() {
+    execCached(source, getInternalScope());
+  });
 }
 
-InMemoryClass::InMemoryClass(StringRef clsName, ArrayRef<StringRef> parentCls,
-                             module &m) : m{m} {
+std::string InMemoryClass::getClassName(StringRef clsName) {
   // intercept invalid class names
   auto valid = StringSwitch<bool>(clsName)
       .Case("return", false)
@@ -32,15 +35,19 @@ InMemoryClass::InMemoryClass(StringRef clsName, ArrayRef<StringRef> parentCls,
   auto name = clsName.str();
   if (!valid)
     name.front() = std::toupper(name.front());
+  return name;
+}
 
-  auto line = pgs.line() << "class " << name << "(";
+InMemoryClass::InMemoryClass(StringRef clsName, ArrayRef<StringRef> parentCls,
+                             module &m) : m{m} {
+  auto line = pgs.line() << "class " << getClassName(clsName) << "(";
   llvm::interleaveComma(parentCls, line, [&](StringRef cls) { line << cls; });
   line << "):" << incr;
 }
 
 InMemoryClass::~InMemoryClass() {
   pgs.endblock();
-  exec(os.str(), m.attr("__dict__"));
+  execCached(os.str(), m.attr("__dict__"));
 }
 
 } // end namespace py
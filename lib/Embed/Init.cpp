@@ -1,4 +1,5 @@
 #include "Scope.h"
+#include "dmc/Embed/Init.h"
 #include "dmc/Embed/Constraints.h"
 #include "dmc/Python/PyMLIR.h"
 
@@ -17,13 +18,30 @@ namespace py {
 
 static bool inited{false};
 
+static std::vector<std::function<void()>> &getDeferred() {
+  static std::vector<std::function<void()>> deferred;
+  return deferred;
+}
+
 void init(MLIRContext *ctx) {
+  setMLIRContext(ctx);
+}
+
+void ensureInit() {
   if (inited)
     return;
   inited = true;
 
-  setMLIRContext(ctx);
   initialize_interpreter();
+  for (auto &fcn : std::exchange(getDeferred(), {}))
+    fcn();
+}
+
+void onInit(std::function<void()> fcn) {
+  if (inited)
+    fcn();
+  else
+    getDeferred().push_back(std::move(fcn));
 }
 
 } // end namespace py
@@ -1,4 +1,5 @@
 #include "Scope.h"
+#include "dmc/Embed/Init.h"
 #include "dmc/Dynamic/DynamicOperation.h"
 #include "dmc/Dynamic/DynamicType.h"
 #include "dmc/Dynamic/DynamicAttribute.h"
@@ -22,6 +23,7 @@ namespace py {
 bool execParser(const std::string &name, OpAsmParser &parser,
                 OperationState &result) {
   constexpr auto parser_policy = return_value_policy::reference;
+  mlir::py::ensureInit();
   ensureBuiltins(getInternalModule());
   auto fcn = getInternalScope()[name.c_str()];
   return fcn.operator()<parser_policy>(parser, result).cast<bool>();
@@ -30,6 +32,7 @@ bool execParser(const std::string &name, OpAsmParser &parser,
 void execPrinter(const std::string &name, OpAsmPrinter &printer, Operation *op,
                  DynamicOperation *spec) {
   constexpr auto printer_policy = return_value_policy::reference;
+  mlir::py::ensureInit();
   ensureBuiltins(getInternalModule());
   auto fcn = getInternalScope()[name.c_str()];
   OperationWrap wrap{op, spec};
@@ -39,6 +42,7 @@ void execPrinter(const std::string &name, OpAsmPrinter &printer, Operation *op,
 bool execParser(const std::string &name, DialectAsmParser &parser,
                 std::vector<Attribute> &result) {
   constexpr auto parser_policy = return_value_policy::reference;
+  mlir::py::ensureInit();
   ensureBuiltins(getInternalModule());
   auto fcn = getInternalScope()[name.c_str()];
   TypeResultWrap wrap{result};
@@ -49,6 +53,7 @@ template <typename DynamicT>
 void execPrinter(const std::string &name, DialectAsmPrinter &printer,
                  DynamicT t) {
   constexpr auto printer_policy = return_value_policy::reference;
+  mlir::py::ensureInit();
   ensureBuiltins(getInternalModule());
   auto fcn = getInternalScope()[name.c_str()];
   TypeWrap wrap{t};
@@ -1,5 +1,6 @@
 #include <pybind11/embed.h>
 
+#include "dmc/Embed/Init.h"
 #include "dmc/Python/PyMLIR.h"
 
 using namespace pybind11;
@@ -7,7 +8,14 @@ using namespace pybind11;
 namespace mlir {
 namespace py {
 
+/// The interpreter is already running when loaded as a Python module.
 void init(MLIRContext *ctx) {}
 
+void ensureInit() {}
+
+void onInit(std::function<void()> fcn) {
+  fcn();
+}
+
 } // end namespace py
 } // end namespace mlir
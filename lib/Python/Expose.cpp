@@ -19,6 +19,7 @@ void getModule(module &m) {
   exposeDialectAsm(m);
 
   exposeBuilder(m);
+  exposeExecutionEngine(m);
 }
 
 } // end namespace py
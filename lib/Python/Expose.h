@@ -44,5 +44,8 @@ void exposeDialectAsm(pybind11::module &m);
 
 void exposeBuilder(pybind11::module &m);
 
+/// In-process execution of lowered modules.
+void exposeExecutionEngine(pybind11::module &m);
+
 } // end namespace py
 } // end namespace mlir
@@ -0,0 +1,76 @@
+#include "Utility.h"
+
+#include <mlir/ExecutionEngine/ExecutionEngine.h>
+#include <mlir/ExecutionEngine/OptUtils.h>
+#include <mlir/IR/Module.h>
+#include <llvm/Support/TargetSelect.h>
+
+#include <chrono>
+#include <stdexcept>
+
+using namespace pybind11;
+
+namespace mlir {
+namespace py {
+
+static void initializeNativeTarget() {
+  static bool initialized = [] {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    return true;
+  }();
+  (void) initialized;
+}
+
+/// JIT compile a module that has been fully lowered to the LLVM dialect and
+/// call its `main() -> i32`. Symbols the module only declares are resolved
+/// against `sharedLibs` and then the host process. Returns the exit code
+/// along with the compile and run times in seconds.
+static tuple jitRunMain(ModuleOp module, unsigned optLevel,
+                        StringList sharedLibs) {
+  if (optLevel > 3)
+    throw std::invalid_argument{"Optimization level must be in [0, 3]"};
+  initializeNativeTarget();
+
+  using Clock = std::chrono::steady_clock;
+  auto seconds = [](Clock::duration d) {
+    return std::chrono::duration<double>(d).count();
+  };
+
+  auto compileStart = Clock::now();
+  std::vector<llvm::StringRef> libPaths{sharedLibs.begin(), sharedLibs.end()};
+  auto transformer = makeOptimizingTransformer(optLevel, /*sizeLevel=*/0,
+                                               /*targetMachine=*/nullptr);
+  auto engine = ExecutionEngine::create(
+      module, /*llvmModuleBuilder=*/nullptr, transformer,
+      static_cast<llvm::CodeGenOpt::Level>(optLevel), libPaths);
+  if (!engine)
+    throw std::runtime_error{"Failed to create execution engine: " +
+                             llvm::toString(engine.takeError())};
+  // Symbol lookup is what materializes the code, so keep it on the compile
+  // side of the clock.
+  auto mainFcn = (*engine)->lookup("main");
+  if (!mainFcn)
+    throw std::runtime_error{"Failed to find `main`: " +
+                             llvm::toString(mainFcn.takeError())};
+  auto compileTime = Clock::now() - compileStart;
+
+  int32_t exitCode = 0;
+  void *args[] = {&exitCode};
+  auto runStart = Clock::now();
+  {
+    gil_scoped_release release;
+    (*mainFcn)(args);
+  }
+  auto runTime = Clock::now() - runStart;
+
+  return make_tuple(exitCode, seconds(compileTime), seconds(runTime));
+}
+
+void exposeExecutionEngine(module &m) {
+  m.def("jitRunMain", &jitRunMain, "module"_a, "optLevel"_a = 2,
+        "sharedLibs"_a = StringList{});
+}
+
+} // end namespace py
+} // end namespace mlir
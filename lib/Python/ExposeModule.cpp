@@ -143,11 +143,21 @@ void exposeModule(module &m, OpClass &cls) {
       .def("rhs", &AddIOp::rhs)
       .def("result", &AddIOp::getResult);
 
+  class_<SubIOp>(m, "SubIOp", cls)
+      .def(init([](Type ty, Value lhs, Value rhs, Location loc) {
+        OpBuilder b{getMLIRContext()};
+        return b.create<SubIOp>(loc, ty, lhs, rhs);
+      }), "ty"_a, "lhs"_a, "rhs"_a, "loc"_a)
+      .def("lhs", &SubIOp::lhs)
+      .def("rhs", &SubIOp::rhs)
+      .def("result", &SubIOp::getResult);
+
   class_<AddFOp>(m, "AddFOp", cls)
       .def(init([](Type ty, Value lhs, Value rhs, Location loc) {
         OpBuilder b{getMLIRContext()};
         return b.create<AddFOp>(loc, ty, lhs, rhs);
       }), "ty"_a, "lhs"_a, "rhs"_a, "loc"_a)
+      .def_static("getName", []() { return AddFOp::getOperationName().str(); })
       .def("lhs", &AddFOp::lhs)
       .def("rhs", &AddFOp::rhs)
       .def("result", &AddFOp::getResult);
@@ -157,6 +167,7 @@ void exposeModule(module &m, OpClass &cls) {
         OpBuilder b{getMLIRContext()};
         return b.create<SubFOp>(loc, ty, lhs, rhs);
       }), "ty"_a, "lhs"_a, "rhs"_a, "loc"_a)
+      .def_static("getName", []() { return SubFOp::getOperationName().str(); })
       .def("lhs", &SubFOp::lhs)
       .def("rhs", &SubFOp::rhs)
       .def("result", &SubFOp::getResult);
@@ -166,6 +177,7 @@ void exposeModule(module &m, OpClass &cls) {
         OpBuilder b{getMLIRContext()};
         return b.create<MulFOp>(loc, ty, lhs, rhs);
       }), "ty"_a, "lhs"_a, "rhs"_a, "loc"_a)
+      .def_static("getName", []() { return MulFOp::getOperationName().str(); })
       .def("lhs", &MulFOp::lhs)
       .def("rhs", &MulFOp::rhs)
       .def("result", &MulFOp::getResult);
@@ -187,6 +199,14 @@ void exposeModule(module &m, OpClass &cls) {
       }), "res"_a, "pred"_a, "lhs"_a, "rhs"_a, "loc"_a)
       .def("result", &CmpIOp::getResult);
 
+  class_<CmpFOp>(m, "CmpFOp", cls)
+      .def(init([](Type res, CmpFPredicate pred, Value lhs, Value rhs,
+                   Location loc) {
+        OpBuilder b{getMLIRContext()};
+        return b.create<CmpFOp>(loc, res, pred, lhs, rhs);
+      }), "res"_a, "pred"_a, "lhs"_a, "rhs"_a, "loc"_a)
+      .def("result", &CmpFOp::getResult);
+
   class_<MulIOp>(m, "MulIOp", cls)
       .def(init([](Type ty, Value lhs, Value rhs, Location loc) {
         OpBuilder b{getMLIRContext()};
@@ -203,6 +223,23 @@ void exposeModule(module &m, OpClass &cls) {
       }), "source"_a, "type"_a, "loc"_a = getUnknownLoc())
       .def("result", &IndexCastOp::getResult);
 
+  class_<FPExtOp>(m, "FPExtOp", cls)
+      .def(init([](Value source, Type type, Location loc) {
+        OpBuilder b{getMLIRContext()};
+        return b.create<FPExtOp>(loc, source, type);
+      }), "source"_a, "type"_a, "loc"_a = getUnknownLoc())
+      .def_static("getName", []() { return FPExtOp::getOperationName().str(); })
+      .def("result", &FPExtOp::getResult);
+
+  class_<FPTruncOp>(m, "FPTruncOp", cls)
+      .def(init([](Value source, Type type, Location loc) {
+        OpBuilder b{getMLIRContext()};
+        return b.create<FPTruncOp>(loc, source, type);
+      }), "source"_a, "type"_a, "loc"_a = getUnknownLoc())
+      .def_static("getName",
+                  []() { return FPTruncOp::getOperationName().str(); })
+      .def("result", &FPTruncOp::getResult);
+
   class_<BranchOp>(m, "BranchOp", cls)
       .def(init([](Block *dest, ValueListRef destOperands, Location loc) {
         OpBuilder b{getMLIRContext()};
@@ -355,7 +392,19 @@ void exposeModule(module &m, OpClass &cls) {
 
   class_<CmpIPredicate>(m, "CmpIPredicate")
       .def_static("eq", []() { return CmpIPredicate::eq; })
-      .def_static("ne", []() { return CmpIPredicate::ne; });
+      .def_static("ne", []() { return CmpIPredicate::ne; })
+      .def_static("slt", []() { return CmpIPredicate::slt; })
+      .def_static("sle", []() { return CmpIPredicate::sle; })
+      .def_static("sgt", []() { return CmpIPredicate::sgt; })
+      .def_static("sge", []() { return CmpIPredicate::sge; });
+
+  class_<CmpFPredicate>(m, "CmpFPredicate")
+      .def_static("oeq", []() { return CmpFPredicate::OEQ; })
+      .def_static("une", []() { return CmpFPredicate::UNE; })
+      .def_static("olt", []() { return CmpFPredicate::OLT; })
+      .def_static("ole", []() { return CmpFPredicate::OLE; })
+      .def_static("ogt", []() { return CmpFPredicate::OGT; })
+      .def_static("oge", []() { return CmpFPredicate::OGE; });
 
   class_<scf::ForOp>(m, "ForOp", cls)
       .def(init([](Value lowerBound, Value upperBound, Value step,
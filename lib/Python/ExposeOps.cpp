@@ -363,7 +363,9 @@ void exposeOps(module &m) {
 } // end namespace mlir
 
 namespace pybind11 {
+/// Operations have no kind to key a table on; `isa<ModuleOp>` compares the
+/// operation name.
 template <> struct polymorphic_type_hook<BaseOp>
-    : public polymorphic_type_hooks<BaseOp,
+    : public polymorphic_type_hooks_uncached<BaseOp,
       ModuleOp> {};
 } // end namespace pybind11
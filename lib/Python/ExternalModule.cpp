@@ -4,6 +4,7 @@
 #include "dmc/Spec/DialectGen.h"
 #include "dmc/Spec/SpecOps.h"
 #include "dmc/Embed/Expose.h"
+#include "dmc/Embed/CodeCache.h"
 
 #include <pybind11/embed.h>
 
@@ -31,4 +32,12 @@ PYBIND11_MODULE(mlir, m) {
     }
     return ret;
   });
+
+  m.def("setCodeCacheDir", &dmc::py::setCodeCacheDir, "dir"_a);
+  m.def("getCodeCacheDir", &dmc::py::getCodeCacheDir);
+  m.def("getCodeCacheStats", []() {
+    auto &stats = dmc::py::getCodeCacheStats();
+    return dict{"hits"_a = stats.hits, "misses"_a = stats.misses,
+                "errors"_a = stats.errors};
+  });
 }
@@ -1,6 +1,7 @@
 #include "dmc/Python/OpAsm.h"
 #include "dmc/Dynamic/DynamicOperation.h"
 #include "dmc/Traits/SpecTraits.h"
+#include "Utility.h"
 
 #include <pybind11/pytypes.h>
 #include <pybind11/pybind11.h>
@@ -48,66 +49,93 @@ Value getResult(OperationWrap &op, unsigned idx) {
   return *getResultGroup(op, idx).begin();
 }
 
-template <typename GetFcn, typename NamedTypeRange>
-std::result_of_t<GetFcn(OperationWrap &, unsigned)>
-getValueOrGroup(OperationWrap &op, GetFcn getVal, std::string name,
-                NamedTypeRange values) {
-  unsigned idx{};
-  for (auto value : values) {
-    if (value.name == name)
-      return getVal(op, idx);
-    ++idx;
-  }
-  throw std::invalid_argument{"Unable to find named value '" + name +
+[[noreturn]] void throwNotFound(OperationWrap &op, StringRef name) {
+  throw std::invalid_argument{"Unable to find named value '" + name.str() +
                               "' for op '" + op.getSpec()->getName() + "'"};
 }
 
-auto isOperandOrResult(OpType opType, StringRef name) {
-  auto pred = [name](const NamedType &ty) { return ty.name == name; };
-  return std::make_pair(llvm::count_if(opType.getOperands(), pred),
-                        llvm::count_if(opType.getResults(), pred));
+unsigned getOperandIndex(OperationWrap &op, StringRef name) {
+  auto *index = op.getSpec()->lookupNamedValue(name);
+  if (!index || !index->operand)
+    throwNotFound(op, name);
+  return *index->operand;
+}
+
+unsigned getResultIndex(OperationWrap &op, StringRef name) {
+  auto *index = op.getSpec()->lookupNamedValue(name);
+  if (!index || !index->result)
+    throwNotFound(op, name);
+  return *index->result;
 }
 
 } // end anonymous namespace
 
 Value OperationWrap::getOperandOrResult(StringRef name) {
-  auto [isOperand, isResult] = isOperandOrResult(type->getOpType(), name);
-  if (isOperand)
-    return getOperand(name.str());
-  if (isResult)
-    return getResult(name.str());
+  if (auto *index = spec->lookupNamedValue(name)) {
+    if (index->operand)
+      return py::getOperand(*this, *index->operand);
+    if (index->result)
+      return py::getResult(*this, *index->result);
+  }
   throw std::invalid_argument{name.str() + " is neither an operand nor a result"
                               " of op '" + spec->getName() + "'"};
 }
 
 ValueRange OperationWrap::getOperandOrResultGroup(StringRef name) {
-  auto [isOperand, isResult] = isOperandOrResult(type->getOpType(), name);
-  if (isOperand)
-    return getOperandGroup(name.str());
-  if (isResult)
-    return getResultGroup(name.str());
+  if (auto *index = spec->lookupNamedValue(name)) {
+    if (index->operand)
+      return py::getOperandGroup(*this, *index->operand);
+    if (index->result)
+      return py::getResultGroup(*this, *index->result);
+  }
   throw std::invalid_argument{name.str() + " is neither an operand nor a result"
                               " of op '" + spec->getName() + "'"};
 }
 
-Value OperationWrap::getOperand(std::string name) {
-  return getValueOrGroup(*this, &py::getOperand, name,
-                         type->getOpType().getOperands());
+Value OperationWrap::getOperand(StringRef name) {
+  return py::getOperand(*this, getOperandIndex(*this, name));
+}
+
+Value OperationWrap::getResult(StringRef name) {
+  return py::getResult(*this, getResultIndex(*this, name));
 }
 
-Value OperationWrap::getResult(std::string name) {
-  return getValueOrGroup(*this, &py::getResult, name,
-                         type->getOpType().getResults());
+ValueRange OperationWrap::getOperandGroup(StringRef name) {
+  return py::getOperandGroup(*this, getOperandIndex(*this, name));
 }
 
-ValueRange OperationWrap::getOperandGroup(std::string name) {
-  return getValueOrGroup(*this, &py::getOperandGroup, name,
-                         type->getOpType().getOperands());
+ValueRange OperationWrap::getResultGroup(StringRef name) {
+  return py::getResultGroup(*this, getResultIndex(*this, name));
 }
 
-ValueRange OperationWrap::getResultGroup(std::string name) {
-  return getValueOrGroup(*this, &py::getResultGroup, name,
-                         type->getOpType().getResults());
+Value OperationWrap::getOperand(unsigned idx) {
+  checkOperandIdx(idx);
+  return py::getOperand(*this, idx);
+}
+
+Value OperationWrap::getResult(unsigned idx) {
+  checkResultIdx(idx);
+  return py::getResult(*this, idx);
+}
+
+ValueRange OperationWrap::getOperandGroup(unsigned idx) {
+  checkOperandIdx(idx);
+  return py::getOperandGroup(*this, idx);
+}
+
+ValueRange OperationWrap::getResultGroup(unsigned idx) {
+  checkResultIdx(idx);
+  return py::getResultGroup(*this, idx);
+}
+
+void OperationWrap::checkOperandIdx(unsigned idx) {
+  if (idx >= type->getOpType().getNumOperands())
+    throw index_error{};
+}
+
+void OperationWrap::checkResultIdx(unsigned idx) {
+  if (idx >= type->getOpType().getNumResults())
+    throw index_error{};
 }
 
 Region &OperationWrap::getRegion(std::string name) {
@@ -173,10 +201,31 @@ void exposeOperationWrap(module &m) {
           types.append(pybind11::cast(type));
         return types;
       })
-      .def("getOperand", &OperationWrap::getOperand)
-      .def("getResult", &OperationWrap::getResult)
-      .def("getOperandGroup", &OperationWrap::getOperandGroup)
-      .def("getResultGroup", &OperationWrap::getResultGroup)
+      .def("getOperand", [](OperationWrap &op, std::string_view name) {
+        return op.getOperand(StringRef{name.data(), name.size()});
+      })
+      .def("getResult", [](OperationWrap &op, std::string_view name) {
+        return op.getResult(StringRef{name.data(), name.size()});
+      })
+      .def("getOperandGroup", [](OperationWrap &op, std::string_view name) {
+        return op.getOperandGroup(StringRef{name.data(), name.size()});
+      })
+      .def("getResultGroup", [](OperationWrap &op, std::string_view name) {
+        return op.getResultGroup(StringRef{name.data(), name.size()});
+      })
+      // Generated op classes know the group index of each named value.
+      .def("getOperandAt",
+           overload<Value(OperationWrap::*)(unsigned)>(
+               &OperationWrap::getOperand))
+      .def("getResultAt",
+           overload<Value(OperationWrap::*)(unsigned)>(
+               &OperationWrap::getResult))
+      .def("getOperandGroupAt",
+           overload<ValueRange(OperationWrap::*)(unsigned)>(
+               &OperationWrap::getOperandGroup))
+      .def("getResultGroupAt",
+           overload<ValueRange(OperationWrap::*)(unsigned)>(
+               &OperationWrap::getResultGroup))
       .def("getOperands", [](OperationWrap &op) -> ValueRange {
         return op.getOp()->getOperands();
       })
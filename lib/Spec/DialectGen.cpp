@@ -12,6 +12,7 @@
 #include "dmc/Embed/TypeFormatGen.h"
 #include "dmc/Embed/InMemoryDef.h"
 #include "dmc/Embed/Expose.h"
+#include "dmc/Embed/Init.h"
 
 using namespace mlir;
 
@@ -202,7 +203,10 @@ LogicalResult registerDialect(DialectOp dialectOp, DynamicContext *ctx,
         return failure();
     }
   }
-  py::exposeDialectInternal(dialect, scope);
+  /// Expose the dialect to Python once the interpreter has started.
+  mlir::py::onInit([dialect, scope{scope.vec()}]() {
+    py::exposeDialectInternal(dialect, scope);
+  });
   return success();
 }
 
@@ -0,0 +1,95 @@
+#!/usr/bin/python3
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+# Times the two luac frontends on a generated Lua file: the ANTLR parser with
+# Generator, and the C++ frontend (`luac`) including parsing its output back
+# into the Python context, which is what `luac.py --frontend native` pays.
+#
+#   python3 bench_frontend.py --luac ../build/lua/luac --lines 50000
+
+cwd = os.path.dirname(os.path.realpath(__file__))
+
+# One unit of generated code, using only constructs both frontends support.
+UNIT = """\
+local t{i} = {{1, 2, x = {i}, ["k{i}"] = {i} * 2}}
+function f{i}(a, b)
+  local s = 0
+  for j = 1, a do
+    s = s + j * b - t{i}.x
+  end
+  if s > {i} then
+    return s
+  elseif s < 0 then
+    return -s
+  else
+    return s .. "x"
+  end
+end
+local n{i} = 0
+while n{i} < 10 do
+  n{i} = n{i} + f{i}(n{i}, 2)
+end
+for k, v in pairs(t{i}) do
+  print(k, v, #t{i})
+end
+repeat
+  n{i} = n{i} - 1
+until n{i} <= 0
+"""
+
+def generate(lines):
+    unit = UNIT.count("\n")
+    return "".join(UNIT.format(i=i) for i in range((lines + unit - 1) // unit))
+
+def timeAntlr(luac, filename, contents):
+    start = time.perf_counter()
+    luac.antlrFrontend(filename, contents)
+    return time.perf_counter() - start
+
+def timeNative(luac, exe, filename):
+    start = time.perf_counter()
+    with tempfile.NamedTemporaryFile(suffix=".mlir") as out:
+        proc = subprocess.run([exe, luac.cwd + "/lua.mlir", filename,
+                               "-o", out.name, "--time"],
+                              stderr=subprocess.PIPE, text=True)
+        if proc.returncode != 0:
+            sys.exit(proc.stderr)
+        total = time.perf_counter() - start
+        start = time.perf_counter()
+        assert luac.parseSourceFile(out.name), "failed to load frontend output"
+        total += time.perf_counter() - start
+    return total, proc.stderr.strip()
+
+def main():
+    parser = argparse.ArgumentParser(description="Lua frontend benchmark")
+    parser.add_argument("--luac", default=os.environ.get(
+                            "LUAC_FRONTEND", cwd + "/luac"),
+                        help="C++ frontend executable")
+    parser.add_argument("--lines", type=int, default=50000,
+                        help="lines of Lua to generate")
+    parser.add_argument("--skip-antlr", action="store_true",
+                        help="only time the C++ frontend")
+    args = parser.parse_args()
+
+    sys.path.insert(0, cwd)
+    sys.argv = sys.argv[:1]
+    import luac
+
+    contents = generate(args.lines)
+    with tempfile.NamedTemporaryFile("w", suffix=".lua") as src:
+        src.write(contents)
+        src.flush()
+        print("{} lines, {} bytes".format(contents.count("\n"), len(contents)))
+        native, report = timeNative(luac, args.luac, src.name)
+        print("native: {:.3f}s ({})".format(native, report))
+        if not args.skip_antlr:
+            antlr = timeAntlr(luac, src.name, contents)
+            print("antlr:  {:.3f}s ({:.1f}x)".format(antlr, antlr / native))
+
+if __name__ == "__main__":
+    main()
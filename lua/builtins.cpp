@@ -1,72 +1,367 @@
 #include "impl.h"
 #include "rx-cpp/src/lua-str.h"
 
-#include <iostream>
-#include <iomanip>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
 #include <random>
 #include <cmath>
+#include <vector>
+
+#include <unistd.h>
 
 namespace lua {
 namespace {
 
-void formatNoop(std::ostream &) {}
+/// Buffered standard output owned by the runtime. Output is written with large
+/// `write` calls and flushed when the buffer fills and at exit, except that an
+/// interactive stdout is flushed after every builtin call.
+class Writer {
+public:
+  static Writer &get() {
+    // Never destroyed: the exit handler flushes it.
+    static Writer &writer = *new Writer;
+    return writer;
+  }
+
+  void write(const char *data, std::size_t len) {
+    if (len > CAPACITY - used) {
+      flush();
+      if (len >= CAPACITY) {
+        writeAll(data, len);
+        return;
+      }
+    }
+    std::memcpy(buf.data() + used, data, len);
+    used += len;
+  }
+  void write(std::string_view str) { write(str.data(), str.size()); }
+  void put(char c) { write(&c, 1); }
+
+  /// Write `len` bytes padded with spaces to `width`.
+  void writePadded(const char *data, std::size_t len, std::size_t width) {
+    write(data, len);
+    for (; len < width; ++len)
+      put(' ');
+  }
+
+  void flush() {
+    writeAll(buf.data(), used);
+    used = 0;
+  }
+
+  /// Called at the end of every output builtin.
+  void endCall() {
+    if (interactive)
+      flush();
+  }
+
+private:
+  static constexpr std::size_t CAPACITY = 1 << 16;
+
+  Writer() : buf(CAPACITY), interactive{isatty(STDOUT_FILENO) != 0} {
+    std::atexit([] { get().flush(); });
+  }
+
+  static void writeAll(const char *data, std::size_t len) {
+    while (len) {
+      auto n = ::write(STDOUT_FILENO, data, len);
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        return;
+      }
+      data += n;
+      len -= n;
+    }
+  }
+
+  std::vector<char> buf;
+  std::size_t used = 0;
+  bool interactive;
+};
+
+/// Buffered standard input owned by the runtime. Reads are done in large
+/// chunks and the readers return views into the buffer, which stay valid until
+/// the next read, so lines and blocks are copied once: into the Lua string.
+class Reader {
+public:
+  static Reader &get() {
+    static Reader &reader = *new Reader;
+    return reader;
+  }
+
+  /// Read up to the next newline, which is consumed and included only if
+  /// `keepNewline` is set. Returns nothing at end of input.
+  std::optional<std::string_view> readLine(bool keepNewline) {
+    std::size_t scanned = 0;
+    for (;;) {
+      auto *start = buf.data() + begin;
+      auto avail = end - begin;
+      if (auto *nl = static_cast<const char *>(
+              std::memchr(start + scanned, '\n', avail - scanned))) {
+        std::size_t len = nl - start;
+        begin += len + 1;
+        return std::string_view{start, keepNewline ? len + 1 : len};
+      }
+      scanned = avail;
+      if (!fill()) {
+        if (!avail)
+          return std::nullopt;
+        begin = end;
+        return std::string_view{buf.data() + end - avail, avail};
+      }
+    }
+  }
+
+  /// Read the rest of the input.
+  std::string_view readAll() {
+    while (fill())
+      ;
+    std::string_view ret{buf.data() + begin, end - begin};
+    begin = end;
+    return ret;
+  }
+
+  /// Read up to `count` bytes. Returns nothing at end of input.
+  std::optional<std::string_view> readBytes(std::size_t count) {
+    while (end - begin < count && fill())
+      ;
+    if (begin == end && (count || !fill()))
+      return std::nullopt;
+    auto len = std::min(count, end - begin);
+    std::string_view ret{buf.data() + begin, len};
+    begin += len;
+    return ret;
+  }
+
+  /// Read a number, skipping leading whitespace. Returns nothing if the input
+  /// does not start with one.
+  std::optional<TObject> readNumber() {
+    // Numerals longer than this are not worth supporting.
+    constexpr std::size_t MAX_LEN = 200;
+    for (;;) {
+      while (begin < end && std::isspace((unsigned char) buf[begin]))
+        ++begin;
+      if (begin < end || !fill())
+        break;
+    }
+    // Only read more while the numeral runs to the end of the buffered
+    // bytes, so a numeral typed on a terminal does not wait for more input.
+    while (end - begin < MAX_LEN && numeralLength() == end - begin && fill())
+      ;
+    char numeral[MAX_LEN + 1];
+    auto len = std::min(MAX_LEN, end - begin);
+    std::memcpy(numeral, buf.data() + begin, len);
+    numeral[len] = '\0';
+
+    char *intEnd, *numEnd;
+    errno = 0;
+    long long iv = std::strtoll(numeral, &intEnd, 10);
+    bool intOk = errno == 0;
+    double num = std::strtod(numeral, &numEnd);
+    if (numEnd == numeral)
+      return std::nullopt;
+    begin += numEnd - numeral;
+    if (intOk && intEnd == numEnd)
+      return lua_make_int(iv);
+    uint64_t u;
+    std::memcpy(&u, &num, sizeof(num));
+    return lua_make_value(NUM, u);
+  }
+
+private:
+  static constexpr std::size_t CHUNK = 1 << 20;
+
+  static bool isNumeralChar(char c) {
+    return std::isxdigit((unsigned char) c) || c == '.' || c == 'x' ||
+           c == 'X' || c == 'p' || c == 'P' || c == '+' || c == '-';
+  }
+
+  /// Length of the run of characters at `begin` that can continue a numeral.
+  std::size_t numeralLength() const {
+    auto i = begin;
+    while (i < end && isNumeralChar(buf[i]))
+      ++i;
+    return i - begin;
+  }
 
-void formatPrint(std::ostream &os) {
-  os << std::left << std::setw(8);
+  /// Read another chunk into the buffer, first moving the unread bytes to the
+  /// front and growing the buffer if that does not leave room for a chunk.
+  /// Returns false at end of input. Invalidates views into the buffer.
+  bool fill() {
+    if (eof)
+      return false;
+    if (begin) {
+      std::memmove(buf.data(), buf.data() + begin, end - begin);
+      end -= begin;
+      begin = 0;
+    }
+    if (buf.size() - end < CHUNK)
+      buf.resize(std::max(2 * buf.size(), end + CHUNK));
+    for (;;) {
+      auto n = ::read(STDIN_FILENO, buf.data() + end, buf.size() - end);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0) {
+        eof = true;
+        return false;
+      }
+      end += n;
+      return true;
+    }
+  }
+
+  std::vector<char> buf;
+  std::size_t begin = 0;
+  std::size_t end = 0;
+  bool eof = false;
+};
+
+/// Builtins return their results here rather than in the lowered program's
+/// return pack buffer, which the runtime cannot see.
+constexpr int32_t MAX_RETS = 16;
+TObject retValues[MAX_RETS];
+
+TPack get_ret_pack(int32_t size) {
+  static bool rooted = [] {
+    gc_add_root(retValues, sizeof(retValues));
+    return true;
+  }();
+  (void) rooted;
+  return TPack{size, retValues};
 }
 
-template <typename FormatFcn>
-void print_impl(FormatFcn formatOutput, TPack pack) {
+TObject make_string(std::string_view str) {
+  return lua_make_impl(STR, new_string(str.data(), str.size()));
+}
+
+TObject make_string_or_nil(std::optional<std::string_view> str) {
+  return str ? make_string(*str) : lua_nil();
+}
+
+void print_impl(std::size_t width, TPack pack) {
+  auto &out = Writer::get();
+  char numeral[64];
   for (int32_t i = 0; i < pack.size; ++i) {
     TObject val = pack.objs[i];
-    switch (val.type) {
+    switch (lua_get_type(val)) {
     case NIL:
       // ignore last nil
-      if (i < pack.size - 1) {
-        formatOutput(std::cout);
-        std::cout << "nil";
-      }
+      if (i < pack.size - 1)
+        out.writePadded("nil", 3, width);
       break;
     case BOOL:
-      formatOutput(std::cout);
-      if (val.b) {
-        std::cout << "true";
+      if (lua_get_bool_val(val)) {
+        out.writePadded("true", 4, width);
       } else {
-        std::cout << "false";
+        out.writePadded("false", 5, width);
       }
       break;
-    case NUM:
-      formatOutput(std::cout);
-      std::cout << val.num;
+    case NUM: {
+      auto len = std::snprintf(numeral, sizeof(numeral), "%g",
+                               lua_get_double_val(val));
+      out.writePadded(numeral, len, width);
       break;
-    case STR:
-      formatOutput(std::cout);
-      std::cout << *((std::string *) val.impl);
+    }
+    case STR: {
+      auto str = as_string_view(val);
+      out.writePadded(str.data(), str.size(), width);
       break;
-    case TBL:
-      std::cout << "table: ";
-      formatOutput(std::cout);
-      std::cout << std::hex << val.impl;
+    }
+    case TBL: {
+      out.write("table: ");
+      auto len = std::snprintf(numeral, sizeof(numeral), "%p",
+                               lua_get_impl(val));
+      out.writePadded(numeral, len, width);
       break;
-    case FCN:
-      std::cout << "function: ";
-      formatOutput(std::cout);
-      std::cout << std::hex << val.impl;
+    }
+    case FCN: {
+      out.write("function: ");
+      auto len = std::snprintf(numeral, sizeof(numeral), "%p",
+                               lua_get_impl(val));
+      out.writePadded(numeral, len, width);
       break;
-    case INT:
-      formatOutput(std::cout);
-      std::cout << val.u;
+    }
+    case INT: {
+      auto len = std::snprintf(numeral, sizeof(numeral), "%" PRId64,
+                               lua_get_int_val(val));
+      out.writePadded(numeral, len, width);
       break;
     }
+    }
   }
 }
 
 TPack fcn_builtin_print(TCapture, TPack pack) {
-  print_impl(&formatPrint, pack);
-  std::cout << std::endl;
+  print_impl(8, pack);
+  Writer::get().put('\n');
+  Writer::get().endCall();
+  return TPack{0, nullptr};
+}
+
+TPack fcn_builtin_io_write(TCapture, TPack pack) {
+  print_impl(0, pack);
+  Writer::get().endCall();
   return TPack{0, nullptr};
 }
 
+/// Read one value from stdin in the given `io.read` format: a byte count, or
+/// one of "l", "L", "a" and "n", optionally prefixed with '*'.
+TObject read_format(TObject fmt) {
+  auto &in = Reader::get();
+  switch (lua_get_type(fmt)) {
+  case INT:
+    return make_string_or_nil(in.readBytes(std::max<int64_t>(
+        0, lua_get_int_val(fmt))));
+  case NUM:
+    return make_string_or_nil(in.readBytes(std::max<int64_t>(
+        0, (int64_t) lua_get_double_val(fmt))));
+  case STR: {
+    auto str = as_string_view(fmt);
+    if (!str.empty() && str[0] == '*')
+      str.remove_prefix(1);
+    switch (str.empty() ? 'l' : str[0]) {
+    case 'a':
+      return make_string(in.readAll());
+    case 'n':
+      return in.readNumber().value_or(lua_nil());
+    case 'L':
+      return make_string_or_nil(in.readLine(true));
+    default:
+      return make_string_or_nil(in.readLine(false));
+    }
+  }
+  default:
+    return make_string_or_nil(in.readLine(false));
+  }
+}
+
+TPack fcn_builtin_io_read(TCapture, TPack pack) {
+  // Prompts written before a read must be visible.
+  Writer::get().endCall();
+  if (pack.size == 0) {
+    auto ret = get_ret_pack(1);
+    ret.objs[0] = read_format(lua_nil());
+    return ret;
+  }
+  auto ret = get_ret_pack(std::min(pack.size, MAX_RETS));
+  for (int32_t i = 0; i < ret.size; ++i) {
+    ret.objs[i] = read_format(pack.objs[i]);
+    // Stop at the first failure, as reference Lua does.
+    if (lua_get_type(ret.objs[i]) == NIL) {
+      ret.size = i + 1;
+      break;
+    }
+  }
+  return ret;
+}
+
 /*int64_t correct_str_offset(std::string &textStr, int64_t offset) {
   if (offset > 0) {
     --offset;
@@ -152,68 +447,6 @@ TPack *fcn_builtin_table_insert(TPack *, TPack *pack) {
   return ret;
 }
 
-TPack *fcn_builtin_io_read(TPack *, TPack *pack) {
-  auto *ctrl = lua_pack_pull_one(pack);
-
-  auto *ret = lua_alloc();
-
-  if (std::cin.peek() == EOF) {
-    lua_set_type(ret, NIL);
-  } else if (lua_get_type(ctrl) == NUM) {
-    lua_set_type(ret, STR);
-    lua_alloc_gc(ret);
-    auto *pstring = new std::string{};
-    ret->gc->pstring = pstring;
-
-    int numChars = (int) lua_get_double_val(ctrl);
-    for (int i = 0; i < numChars; ++i) {
-      auto nextChar = std::cin.get();
-      if (nextChar == EOF) {
-        break;
-      }
-      *pstring += nextChar;
-    }
-  } else if (lua_get_type(ctrl) == STR) {
-    if (lua::as_std_string(ctrl) == "*all") {
-      lua_set_type(ret, STR);
-      lua_alloc_gc(ret);
-      auto *pstring = new std::string{};
-      ret->gc->pstring = pstring;
-
-      int nextChar;
-      while ((nextChar = std::cin.get()) != EOF) {
-        *pstring += nextChar;
-      }
-    } else if (lua::as_std_string(ctrl) == "*number") {
-      ret->type = NUM;
-      std::cin >> ret->num;
-    } else {
-      goto read_line;
-    }
-  } else {
-read_line:
-    lua_set_type(ret, STR);
-    lua_alloc_gc(ret);
-    auto *pstring = new std::string{};
-    ret->gc->pstring = pstring;
-    std::getline(std::cin, *pstring);
-  }
-
-  auto *retpack = lua_new_ret_pack(1);
-  lua_pack_push(retpack, ret);
-  return retpack;
-}
-
-TPack *fcn_builtin_io_write(TPack *, TPack *pack) {
-  print_impl(&formatNoop, pack);
-
-  auto *ret = lua_new_ret_pack(1);
-  auto *nil = lua_alloc();
-  lua_set_type(nil, NIL);
-  lua_pack_push(ret, nil);
-  return ret;
-}
-
 TPack *fcn_builtin_math_random(TPack *, TPack *pack) {
   thread_local std::random_device rd;
   thread_local std::default_random_engine e2{rd()};
@@ -242,10 +475,22 @@ TPack *fcn_builtin_math_random(TPack *, TPack *pack) {
 }*/
 
 TObject construct_builtin_print(void) {
-  TObject print;
-  print.type = FCN;
-  print.impl = new TClosure{&fcn_builtin_print, nullptr};
-  return print;
+  auto *closure = new_closure(&fcn_builtin_print, nullptr);
+  gc_fix(closure);
+  return lua_make_impl(FCN, closure);
+}
+
+TObject construct_builtin_io(void) {
+  auto *io = lua_new_table_impl();
+  gc_fix(io);
+  auto addFcn = [io](const char *name, lua_fcn_t fcn) {
+    auto *str = lua_load_string_impl(name, std::strlen(name));
+    auto key = lua_make_impl(STR, str);
+    lua_table_set_impl(io, key, lua_make_impl(FCN, new_closure(fcn, nullptr)));
+  };
+  addFcn("read", &fcn_builtin_io_read);
+  addFcn("write", &fcn_builtin_io_write);
+  return lua_make_impl(TBL, io);
 }
 
 /*TObject *construct_builtin_string(void) {
@@ -291,32 +536,6 @@ TObject *construct_builtin_table(void) {
   return table;
 }
 
-TObject *construct_builtin_io(void) {
-  TObject *io = lua_alloc();
-  lua_set_type(io, TBL);
-  lua_alloc_gc(io);
-  lua_init_table(io);
-  {
-    TObject *read = lua_alloc();
-    lua_set_type(read, FCN);
-    lua_alloc_gc(read);
-    lua_set_fcn_addr(read, &fcn_builtin_io_read);
-    lua_set_capture_pack(read, nullptr);
-    auto *key = lua_load_string("read", 4);
-    lua_table_set(io, key, read);
-  }
-  {
-    TObject *write = lua_alloc();
-    lua_set_type(write, FCN);
-    lua_alloc_gc(write);
-    lua_set_fcn_addr(write, &fcn_builtin_io_write);
-    lua_set_capture_pack(write, nullptr);
-    auto *key = lua_load_string("write", 5);
-    lua_table_set(io, key, write);
-  }
-  return io;
-}
-
 TObject *construct_builtin_math(void) {
   TObject *math = lua_alloc();
   lua_set_type(math, TBL);
@@ -335,6 +554,9 @@ TObject *construct_builtin_math(void) {
 }*/
 
 } // end anonymous namespace
+
+void flush_output() { Writer::get().flush(); }
+
 } // end namespace lua
 
 extern "C" {
@@ -342,7 +564,7 @@ extern "C" {
 TObject lua_builtin_print = lua::construct_builtin_print();
 //TObject lua_builtin_string = lua::construct_builtin_string();
 //TObject lua_builtin_table = lua::construct_builtin_table();
-//TObject lua_builtin_io = lua::construct_builtin_io();
+TObject lua_builtin_io = lua::construct_builtin_io();
 //TObject lua_builtin_random = lua::construct_builtin_math();
 //TObject lua_builtin_math = lua::construct_builtin_math();
 
@@ -0,0 +1,1262 @@
+/// Native Lua frontend. Lexes and parses a Lua file with a hand-written
+/// recursive-descent parser and emits the `lua` dialect directly, without
+/// building a parse tree. The output is the module `Generator` in luac.py
+/// produces, op for op and with the same locations, so it can be handed to
+/// the rest of the luac pipeline with `luac.py --frontend native`.
+///
+///   luac lua.mlir fannkuch.lua -o fannkuch.mlir --time
+
+#include "dmc/Dynamic/DynamicContext.h"
+#include "dmc/Dynamic/DynamicDialect.h"
+#include "dmc/Dynamic/DynamicOperation.h"
+#include "dmc/Dynamic/DynamicType.h"
+#include "dmc/IO/ModuleWriter.h"
+#include "dmc/Spec/DialectGen.h"
+#include "dmc/Spec/SpecDialect.h"
+#include "dmc/Traits/Registry.h"
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/ADT/StringSwitch.h>
+#include <llvm/Support/ConvertUTF.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+#include <mlir/IR/Builders.h>
+#include <mlir/IR/Diagnostics.h>
+#include <mlir/IR/Module.h>
+#include <mlir/IR/Verifier.h>
+#include <mlir/Parser.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace mlir;
+using namespace llvm;
+using namespace dmc;
+
+static DialectRegistration<SpecDialect> specDialectRegistration;
+static DialectRegistration<TraitRegistry> registerTraits;
+
+namespace {
+
+//===----------------------------------------------------------------------===//
+// Lexer
+//===----------------------------------------------------------------------===//
+
+enum class Tok {
+  Eof, Name, Int, Hex, Float, HexFloat, String, LongString,
+
+  // Keywords.
+  And, Break, Do, Else, Elseif, End, False, For, Function, Goto, If, In,
+  Local, Nil, Not, Or, Repeat, Return, Then, True, Until, While,
+
+  // Symbols.
+  Plus, Minus, Star, Slash, DoubleSlash, Percent, Caret, Hash, Amp, Tilde,
+  Pipe, Shl, Shr, Concat, Ellipsis, Eq, Ne, Lt, Gt, Le, Ge, Assign,
+  LParen, RParen, LBrace, RBrace, LBracket, RBracket, DoubleColon, Colon,
+  Semi, Comma, Dot,
+};
+
+/// Lines are 1-based and columns 0-based, as ANTLR counts them, so locations
+/// match the ones the Python frontend attaches.
+struct Token {
+  Tok kind;
+  StringRef text;
+  unsigned line, col;
+};
+
+struct SyntaxError {
+  unsigned line, col;
+  std::string msg;
+};
+
+class Lexer {
+public:
+  explicit Lexer(StringRef buf) : buf{buf} {}
+
+  std::vector<Token> lexAll() {
+    std::vector<Token> toks;
+    // Roughly one token per 4 characters of typical Lua.
+    toks.reserve(buf.size() / 4);
+    if (buf.startswith("#!"))
+      skipLine();
+    do {
+      toks.push_back(lex());
+    } while (toks.back().kind != Tok::Eof);
+    return toks;
+  }
+
+private:
+  StringRef buf;
+  size_t pos = 0;
+  unsigned line = 1, col = 0;
+
+  char peek(size_t ahead = 0) const {
+    return pos + ahead < buf.size() ? buf[pos + ahead] : '\0';
+  }
+
+  void advance(size_t n = 1) {
+    for (; n && pos < buf.size(); --n, ++pos) {
+      if (buf[pos] == '\n') {
+        ++line;
+        col = 0;
+      } else {
+        ++col;
+      }
+    }
+  }
+
+  [[noreturn]] void error(const std::string &msg) {
+    throw SyntaxError{line, col, msg};
+  }
+
+  void skipLine() {
+    while (pos < buf.size() && peek() != '\n')
+      advance();
+  }
+
+  /// If a long bracket `[==[` starts here, return its level (the number of
+  /// `=`), otherwise -1.
+  int longBracketLevel() const {
+    if (peek() != '[')
+      return -1;
+    size_t n = 1;
+    while (peek(n) == '=')
+      ++n;
+    return peek(n) == '[' ? int(n - 1) : -1;
+  }
+
+  /// Skip a long bracket of the given level, including its delimiters.
+  void skipLongBracket(int level) {
+    advance(level + 2);
+    for (;;) {
+      if (pos >= buf.size())
+        error("unfinished long string or comment");
+      if (peek() == ']') {
+        size_t n = 1;
+        while (peek(n) == '=')
+          ++n;
+        if (int(n - 1) == level && peek(n) == ']') {
+          advance(n + 1);
+          return;
+        }
+      }
+      advance();
+    }
+  }
+
+  void skipTrivia() {
+    for (;;) {
+      char c = peek();
+      if (c == ' ' || c == '\t' || c == '\f' || c == '\r' || c == '\n') {
+        advance();
+      } else if (c == '-' && peek(1) == '-') {
+        advance(2);
+        int level = longBracketLevel();
+        if (level >= 0)
+          skipLongBracket(level);
+        else
+          skipLine();
+      } else {
+        return;
+      }
+    }
+  }
+
+  static bool isNameStart(char c) {
+    return isalpha(static_cast<unsigned char>(c)) || c == '_';
+  }
+  static bool isNameChar(char c) {
+    return isalnum(static_cast<unsigned char>(c)) || c == '_';
+  }
+  static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+  static bool isHexDigit(char c) {
+    return isxdigit(static_cast<unsigned char>(c));
+  }
+
+  Tok lexNumber() {
+    if (peek() == '0' && (peek(1) == 'x' || peek(1) == 'X')) {
+      advance(2);
+      bool isFloat = false;
+      while (isHexDigit(peek()))
+        advance();
+      if (peek() == '.') {
+        isFloat = true;
+        advance();
+        while (isHexDigit(peek()))
+          advance();
+      }
+      if (peek() == 'p' || peek() == 'P') {
+        isFloat = true;
+        advance();
+        if (peek() == '+' || peek() == '-')
+          advance();
+        if (!isDigit(peek()))
+          error("malformed number");
+        while (isDigit(peek()))
+          advance();
+      }
+      return isFloat ? Tok::HexFloat : Tok::Hex;
+    }
+    bool isFloat = false;
+    while (isDigit(peek()))
+      advance();
+    // `1..x` is a number followed by a concatenation.
+    if (peek() == '.' && peek(1) != '.') {
+      isFloat = true;
+      advance();
+      while (isDigit(peek()))
+        advance();
+    }
+    if (peek() == 'e' || peek() == 'E') {
+      isFloat = true;
+      advance();
+      if (peek() == '+' || peek() == '-')
+        advance();
+      if (!isDigit(peek()))
+        error("malformed number");
+      while (isDigit(peek()))
+        advance();
+    }
+    return isFloat ? Tok::Float : Tok::Int;
+  }
+
+  /// Strings are kept as spelled, with quotes and escapes, as the Python
+  /// frontend does.
+  void lexString(char quote) {
+    advance();
+    for (;;) {
+      char c = peek();
+      if (pos >= buf.size() || c == '\n')
+        error("unfinished string");
+      if (c == '\\') {
+        advance(2);
+      } else {
+        advance();
+        if (c == quote)
+          return;
+      }
+    }
+  }
+
+  Tok lexSymbol() {
+    char c = peek(), n = peek(1);
+    auto take = [&](size_t len, Tok kind) {
+      advance(len);
+      return kind;
+    };
+    switch (c) {
+    case '+': return take(1, Tok::Plus);
+    case '-': return take(1, Tok::Minus);
+    case '*': return take(1, Tok::Star);
+    case '/': return n == '/' ? take(2, Tok::DoubleSlash) : take(1, Tok::Slash);
+    case '%': return take(1, Tok::Percent);
+    case '^': return take(1, Tok::Caret);
+    case '#': return take(1, Tok::Hash);
+    case '&': return take(1, Tok::Amp);
+    case '~': return n == '=' ? take(2, Tok::Ne) : take(1, Tok::Tilde);
+    case '|': return take(1, Tok::Pipe);
+    case '<':
+      if (n == '<') return take(2, Tok::Shl);
+      return n == '=' ? take(2, Tok::Le) : take(1, Tok::Lt);
+    case '>':
+      if (n == '>') return take(2, Tok::Shr);
+      return n == '=' ? take(2, Tok::Ge) : take(1, Tok::Gt);
+    case '=': return n == '=' ? take(2, Tok::Eq) : take(1, Tok::Assign);
+    case '(': return take(1, Tok::LParen);
+    case ')': return take(1, Tok::RParen);
+    case '{': return take(1, Tok::LBrace);
+    case '}': return take(1, Tok::RBrace);
+    case '[': return take(1, Tok::LBracket);
+    case ']': return take(1, Tok::RBracket);
+    case ':': return n == ':' ? take(2, Tok::DoubleColon) : take(1, Tok::Colon);
+    case ';': return take(1, Tok::Semi);
+    case ',': return take(1, Tok::Comma);
+    case '.':
+      if (n != '.') return take(1, Tok::Dot);
+      return peek(2) == '.' ? take(3, Tok::Ellipsis) : take(2, Tok::Concat);
+    default:
+      error(std::string{"unexpected character '"} + c + "'");
+    }
+  }
+
+  Token lex() {
+    skipTrivia();
+    Token tok{Tok::Eof, StringRef{}, line, col};
+    size_t start = pos;
+    if (pos >= buf.size())
+      return tok;
+
+    char c = peek();
+    if (isNameStart(c)) {
+      while (isNameChar(peek()))
+        advance();
+      tok.kind = StringSwitch<Tok>(buf.slice(start, pos))
+          .Case("and", Tok::And).Case("break", Tok::Break)
+          .Case("do", Tok::Do).Case("else", Tok::Else)
+          .Case("elseif", Tok::Elseif).Case("end", Tok::End)
+          .Case("false", Tok::False).Case("for", Tok::For)
+          .Case("function", Tok::Function).Case("goto", Tok::Goto)
+          .Case("if", Tok::If).Case("in", Tok::In)
+          .Case("local", Tok::Local).Case("nil", Tok::Nil)
+          .Case("not", Tok::Not).Case("or", Tok::Or)
+          .Case("repeat", Tok::Repeat).Case("return", Tok::Return)
+          .Case("then", Tok::Then).Case("true", Tok::True)
+          .Case("until", Tok::Until).Case("while", Tok::While)
+          .Default(Tok::Name);
+    } else if (isDigit(c) || (c == '.' && isDigit(peek(1)))) {
+      tok.kind = lexNumber();
+    } else if (c == '"' || c == '\'') {
+      lexString(c);
+      tok.kind = Tok::String;
+    } else if (int level = longBracketLevel(); level >= 0) {
+      skipLongBracket(level);
+      tok.kind = Tok::LongString;
+    } else {
+      tok.kind = lexSymbol();
+    }
+    tok.text = buf.slice(start, pos);
+    return tok;
+  }
+};
+
+//===----------------------------------------------------------------------===//
+// Parser and MLIR Generator
+//===----------------------------------------------------------------------===//
+
+/// Binary operator precedence, lowest first, in the order of the `exp`
+/// alternatives in Lua.g4. Note that the grammar puts the bitwise operators
+/// below `or`.
+enum Prec : unsigned {
+  NoPrec = 0, Bitwise, Or, And, Comparison, Strcat, AddSub, MulDivMod,
+  Unary, Power,
+};
+
+static unsigned binaryPrec(Tok kind) {
+  switch (kind) {
+  case Tok::Amp: case Tok::Pipe: case Tok::Tilde: case Tok::Shl:
+  case Tok::Shr:
+    return Bitwise;
+  case Tok::Or: return Or;
+  case Tok::And: return And;
+  case Tok::Lt: case Tok::Gt: case Tok::Le: case Tok::Ge: case Tok::Eq:
+  case Tok::Ne:
+    return Comparison;
+  case Tok::Concat: return Strcat;
+  case Tok::Plus: case Tok::Minus: return AddSub;
+  case Tok::Star: case Tok::Slash: case Tok::Percent: case Tok::DoubleSlash:
+    return MulDivMod;
+  case Tok::Caret: return Power;
+  default: return NoPrec;
+  }
+}
+
+/// The `lua` ops the frontend emits, resolved once against the dialect.
+struct LuaOps {
+  OperationName concat, unpack, alloc_local, get_or_alloc, assign, call, nil,
+      boolean, number, table, table_get, table_set, get_string, binary, unary,
+      numeric_for, generic_for, function_def, cond_if, loop_while, repeat,
+      until, end, ret, cond;
+};
+
+/// Mirrors `Generator` in luac.py: every helper below emits the ops of its
+/// namesake there, in the same order and with the same locations. Parsing and
+/// emission happen in one pass, so where the tree walk would look ahead in
+/// the parse tree the parser peeks at the next token instead.
+class Generator {
+public:
+  Generator(MLIRContext *ctx, StringRef filename, std::vector<Token> toks,
+            Type valType, Type packType, const LuaOps &ops)
+      : ctx{ctx}, builder{ctx}, filename{filename}, toks{std::move(toks)},
+        valType{valType}, packType{packType}, ops{ops} {}
+
+  ModuleOp chunk(ModuleWriter &writer) {
+    auto main = writer.createFunction("lua_main", {}, {packType});
+    main.getOperation()->setLoc(getLoc(cur()));
+    pushBlock(main.addEntryBlock());
+
+    block();
+    if (at(Tok::Return))
+      error("unexpected return statement");
+    Token eof = expect(Tok::Eof, "<eof>");
+    makeConcat(ops.ret, {}, {}, getLoc(eof));
+    popBlock();
+    return writer.getModule();
+  }
+
+private:
+  MLIRContext *ctx;
+  OpBuilder builder;
+  StringRef filename;
+  std::vector<Token> toks;
+  size_t idx = 0;
+  Type valType, packType;
+  const LuaOps &ops;
+  std::vector<OpBuilder::InsertPoint> blockStack;
+
+  //===--------------------------------------------------------------------===//
+  // Helpers
+  //===--------------------------------------------------------------------===//
+
+  const Token &cur() const { return toks[idx]; }
+  const Token &peek(size_t ahead) const {
+    return toks[std::min(idx + ahead, toks.size() - 1)];
+  }
+  /// The last token consumed, which ends the construct just parsed.
+  const Token &prev() const { return toks[idx ? idx - 1 : 0]; }
+  bool at(Tok kind) const { return cur().kind == kind; }
+
+  const Token &consume() {
+    const Token &tok = toks[idx];
+    if (tok.kind != Tok::Eof)
+      ++idx;
+    return tok;
+  }
+
+  bool accept(Tok kind) {
+    if (!at(kind))
+      return false;
+    consume();
+    return true;
+  }
+
+  const Token &expect(Tok kind, StringRef spelling) {
+    if (!at(kind))
+      error("'" + spelling.str() + "' expected near '" +
+            (at(Tok::Eof) ? "<eof>" : cur().text.str()) + "'");
+    return consume();
+  }
+
+  [[noreturn]] void error(const std::string &msg) {
+    throw SyntaxError{cur().line, cur().col, msg};
+  }
+  [[noreturn]] void error(const Token &tok, const std::string &msg) {
+    throw SyntaxError{tok.line, tok.col, msg};
+  }
+
+  Location getLoc(const Token &tok) {
+    return FileLineColLoc::get(filename, tok.line, tok.col, ctx);
+  }
+
+  Operation *create(OperationName name, Location loc, ValueRange operands,
+                    ArrayRef<Type> results,
+                    ArrayRef<NamedAttribute> attrs = {},
+                    unsigned numRegions = 0) {
+    OperationState state{loc, name};
+    state.addOperands(operands);
+    state.addTypes(results);
+    state.addAttributes(attrs);
+    for (unsigned i = 0; i < numRegions; ++i)
+      state.addRegion();
+    return builder.createOperation(state);
+  }
+
+  NamedAttribute attr(StringRef name, Attribute value) {
+    return builder.getNamedAttr(name, value);
+  }
+
+  Block *addEntryBlock(Region &region, unsigned numArgs) {
+    auto *block = new Block;
+    region.push_back(block);
+    block->addArguments(SmallVector<Type, 4>(numArgs, valType));
+    return block;
+  }
+
+  void pushBlock(Block *block) {
+    blockStack.push_back(builder.saveInsertionPoint());
+    builder.setInsertionPointToEnd(block);
+  }
+
+  void popBlock() {
+    assert(!blockStack.empty() && "too many block pops");
+    builder.restoreInsertionPoint(blockStack.back());
+    blockStack.pop_back();
+  }
+
+  Operation *makeConcat(OperationName name, ArrayRef<Value> vals,
+                        ArrayRef<Value> tail, Location loc) {
+    SmallVector<Value, 8> operands{vals.begin(), vals.end()};
+    operands.append(tail.begin(), tail.end());
+    auto segments = builder.getI64VectorAttr(
+        {int64_t(vals.size()), int64_t(tail.size())});
+    SmallVector<Type, 1> results;
+    if (name == ops.concat)
+      results.push_back(packType);
+    return create(name, loc, operands, results,
+                  {attr("operand_segment_sizes", segments)});
+  }
+
+  Value createVal(OperationName name, Location loc, ValueRange operands = {},
+                  ArrayRef<NamedAttribute> attrs = {}) {
+    return create(name, loc, operands, {valType}, attrs)->getResult(0);
+  }
+
+  SmallVector<Value, 4> unpack(Value pack, unsigned n, Location loc) {
+    auto *op = create(ops.unpack, loc, {pack},
+                      SmallVector<Type, 4>(n, valType));
+    return llvm::to_vector<4>(op->getResults());
+  }
+
+  Value getString(StringRef text, Location loc) {
+    return createVal(ops.get_string, loc, {},
+                     {attr("value", builder.getStringAttr(text))});
+  }
+
+  //===--------------------------------------------------------------------===//
+  // Statements
+  //===--------------------------------------------------------------------===//
+
+  bool atBlockEnd() const {
+    switch (cur().kind) {
+    case Tok::Eof: case Tok::End: case Tok::Else: case Tok::Elseif:
+    case Tok::Until: case Tok::Return:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  void block() {
+    while (!atBlockEnd())
+      stat();
+  }
+
+  /// Parse `'return' explist? ';'?` if present. Emission of the `lua.ret` is
+  /// left to the caller, since its location is the end of the enclosing
+  /// construct.
+  bool retstat(SmallVectorImpl<Value> &vals, SmallVectorImpl<Value> &tail) {
+    if (!accept(Tok::Return))
+      return false;
+    if (!atBlockEnd() && !at(Tok::Semi))
+      getValsAndTail(vals, tail);
+    accept(Tok::Semi);
+    return true;
+  }
+
+  void noRetstat(const char *msg) {
+    if (at(Tok::Return))
+      error(msg);
+  }
+
+  void stat() {
+    switch (cur().kind) {
+    case Tok::Semi: consume(); return;
+    case Tok::DoubleColon: error("label not implemented");
+    case Tok::Break: error("breakstmt not implemented");
+    case Tok::Goto: error("gotostmt not implemented");
+    case Tok::Do: error("enclosedblock not implemented");
+    case Tok::While: return whileloop();
+    case Tok::Repeat: return repeatloop();
+    case Tok::If: return conditionalchain();
+    case Tok::For:
+      return peek(2).kind == Tok::Assign ? numericfor() : genericfor();
+    case Tok::Function: return namedfunctiondef();
+    case Tok::Local:
+      return peek(1).kind == Tok::Function ? localnamedfunctiondef()
+                                           : localvarlist();
+    default:
+      return assignOrCall();
+    }
+  }
+
+  /// `varlist '=' explist` or `functioncall`. Both start with a prefix
+  /// expression, which tells them apart by what it ends with.
+  void assignOrCall() {
+    Token start = cur();
+    bool isVar;
+    Value val = prefixexp(/*allowPack=*/true, isVar);
+    if (!isVar) {
+      if (at(Tok::Assign) || at(Tok::Comma))
+        error(start, "syntax error: cannot assign to a function call");
+      return;
+    }
+    SmallVector<Value, 4> varList{val};
+    while (accept(Tok::Comma)) {
+      varList.push_back(prefixexp(/*allowPack=*/false, isVar));
+      if (!isVar)
+        error(prev(), "syntax error: cannot assign to a function call");
+    }
+    expect(Tok::Assign, "=");
+    handleAssignList(varList);
+  }
+
+  void handleAssignList(ArrayRef<Value> varList) {
+    auto loc = getLoc(cur());
+    Value expPack = explist();
+    auto vals = unpack(expPack, varList.size(), loc);
+    for (unsigned i = 0; i < varList.size(); ++i)
+      create(ops.assign, loc, {varList[i], vals[i]}, {valType});
+  }
+
+  void localvarlist() {
+    auto loc = getLoc(consume());
+    SmallVector<Value, 4> varList;
+    do {
+      Token name = expect(Tok::Name, "<name>");
+      varList.push_back(createVal(
+          ops.alloc_local, loc, {},
+          {attr("var", builder.getStringAttr(name.text))}));
+    } while (accept(Tok::Comma));
+    if (accept(Tok::Assign))
+      handleAssignList(varList);
+  }
+
+  void namedfunctiondef() {
+    auto loc = getLoc(consume());
+    Token name = expect(Tok::Name, "<name>");
+    bool simpleName = true;
+    while (accept(Tok::Dot) || accept(Tok::Colon)) {
+      expect(Tok::Name, "<name>");
+      simpleName = false;
+    }
+    Value fcn = funcbody(loc);
+    if (!simpleName)
+      error(name, "only simple function names supported");
+    Value var = createVal(ops.get_or_alloc, loc, {},
+                          {attr("var", builder.getStringAttr(name.text))});
+    create(ops.assign, loc, {var, fcn}, {valType});
+  }
+
+  void localnamedfunctiondef() {
+    auto loc = getLoc(consume());
+    expect(Tok::Function, "function");
+    Token name = expect(Tok::Name, "<name>");
+    Value fcn = funcbody(loc);
+    Value var = createVal(ops.alloc_local, loc, {},
+                          {attr("var", builder.getStringAttr(name.text))});
+    create(ops.assign, loc, {var, fcn}, {valType});
+  }
+
+  void numericfor() {
+    auto loc = getLoc(consume());
+    Token name = expect(Tok::Name, "<name>");
+    expect(Tok::Assign, "=");
+    Value lower = exp();
+    expect(Tok::Comma, ",");
+    Value upper = exp();
+    Value step;
+    if (accept(Tok::Comma))
+      step = exp();
+    else
+      step = createVal(ops.number, loc, {},
+                       {attr("value", builder.getI64IntegerAttr(1))});
+    expect(Tok::Do, "do");
+
+    auto *loop = create(ops.numeric_for, loc, {lower, upper, step}, {},
+                        {attr("ivar", builder.getStringAttr(name.text))}, 1);
+    pushBlock(addEntryBlock(loop->getRegion(0), 1));
+    block();
+    noRetstat("unsupported return statement");
+    create(ops.end, loc, {}, {});
+    popBlock();
+    expect(Tok::End, "end");
+  }
+
+  void genericfor() {
+    Token forTok = consume();
+    auto loc = getLoc(forTok);
+    SmallVector<Attribute, 4> params;
+    do {
+      params.push_back(
+          builder.getStringAttr(expect(Tok::Name, "<name>").text));
+    } while (accept(Tok::Comma));
+    expect(Tok::In, "in");
+    Value expPack = explist();
+    auto itVars = unpack(expPack, 3, loc);
+    expect(Tok::Do, "do");
+
+    auto *loop = create(ops.generic_for, loc, itVars, {},
+                        {attr("params", builder.getArrayAttr(params))}, 1);
+    pushBlock(addEntryBlock(loop->getRegion(0), params.size()));
+    block();
+    noRetstat("unexpected terminator statement");
+    create(ops.end, getLoc(expect(Tok::End, "end")), {}, {});
+    popBlock();
+  }
+
+  void whileloop() {
+    auto *loop = create(ops.loop_while, getLoc(consume()), {}, {}, {}, 2);
+    pushBlock(addEntryBlock(loop->getRegion(0), 0));
+    auto condLoc = getLoc(cur());
+    Value cond = exp();
+    create(ops.cond, condLoc, {cond}, {});
+    popBlock();
+    expect(Tok::Do, "do");
+
+    pushBlock(addEntryBlock(loop->getRegion(1), 0));
+    block();
+    noRetstat("unexpected terminator in while");
+    create(ops.end, getLoc(prev()), {}, {});
+    popBlock();
+    expect(Tok::End, "end");
+  }
+
+  void repeatloop() {
+    auto *loop = create(ops.repeat, getLoc(consume()), {}, {}, {}, 1);
+    pushBlock(addEntryBlock(loop->getRegion(0), 0));
+    block();
+    noRetstat("unexpected terminator in repeat");
+    expect(Tok::Until, "until");
+    auto condLoc = getLoc(cur());
+    auto *until = create(ops.until, condLoc, {}, {}, {}, 1);
+    pushBlock(addEntryBlock(until->getRegion(0), 0));
+    Value cond = exp();
+    create(ops.cond, condLoc, {cond}, {});
+    popBlock();
+    popBlock();
+  }
+
+  /// Emit the terminator of an `if` branch: its `return`, if any, or
+  /// `lua.end`, located at the last token of the branch.
+  void handleCondRetstat() {
+    SmallVector<Value, 4> vals, tail;
+    if (retstat(vals, tail))
+      makeConcat(ops.ret, vals, tail, getLoc(prev()));
+    else
+      create(ops.end, getLoc(prev()), {}, {});
+  }
+
+  /// Emit `if`/`elseif` and leave the builder in its else region. Returns
+  /// the last token of the branch.
+  Token ifblock() {
+    auto loc = getLoc(consume());
+    Value cond = exp();
+    expect(Tok::Then, "then");
+    auto *condIf = create(ops.cond_if, loc, {cond}, {}, {}, 2);
+    pushBlock(addEntryBlock(condIf->getRegion(0), 0));
+    block();
+    handleCondRetstat();
+    Token last = prev();
+    popBlock();
+
+    pushBlock(addEntryBlock(condIf->getRegion(1), 0));
+    return last;
+  }
+
+  void conditionalchain() {
+    Token ifEnd = ifblock();
+    SmallVector<Token, 4> elseifEnds;
+    while (at(Tok::Elseif))
+      elseifEnds.push_back(ifblock());
+    if (accept(Tok::Else)) {
+      block();
+      handleCondRetstat();
+    } else {
+      create(ops.end, getLoc(ifEnd), {}, {});
+    }
+    for (auto &elseifEnd : elseifEnds) {
+      popBlock();
+      create(ops.end, getLoc(elseifEnd), {}, {});
+    }
+    popBlock();
+    expect(Tok::End, "end");
+  }
+
+  //===--------------------------------------------------------------------===//
+  // Expressions
+  //===--------------------------------------------------------------------===//
+
+  /// Parse `exp (',' exp)*`. Only the last expression may yield a pack, which
+  /// becomes the tail.
+  void getValsAndTail(SmallVectorImpl<Value> &vals,
+                      SmallVectorImpl<Value> &tail) {
+    do {
+      vals.push_back(exp(/*allowPack=*/true));
+    } while (accept(Tok::Comma));
+    if (vals.back().getType() == packType)
+      tail.push_back(vals.pop_back_val());
+  }
+
+  Value explist() {
+    auto loc = getLoc(cur());
+    SmallVector<Value, 4> vals, tail;
+    getValsAndTail(vals, tail);
+    return makeConcat(ops.concat, vals, tail, loc)->getResult(0);
+  }
+
+  /// `allowPack` lets a trailing call return its whole pack, when the
+  /// expression turns out to be the last of an explist.
+  Value exp(bool allowPack = false, unsigned minPrec = Bitwise) {
+    Value lhs = simpleexp(allowPack);
+    for (;;) {
+      unsigned prec = binaryPrec(cur().kind);
+      if (prec < minPrec || prec == NoPrec)
+        return lhs;
+      Token opTok = consume();
+      // `^` and `..` are right associative.
+      bool rightAssoc = prec == Power || prec == Strcat;
+      Value rhs = exp(/*allowPack=*/false, rightAssoc ? prec : prec + 1);
+      lhs = createVal(ops.binary, getLoc(opTok), {lhs, rhs},
+                      {attr("op", builder.getStringAttr(opTok.text))});
+    }
+  }
+
+  Value simpleexp(bool allowPack) {
+    const Token &tok = cur();
+    auto loc = getLoc(tok);
+    switch (tok.kind) {
+    case Tok::Nil:
+      consume();
+      return createVal(ops.nil, loc);
+    case Tok::False:
+    case Tok::True:
+      consume();
+      return createVal(ops.boolean, loc, {},
+                       {attr("value", builder.getIntegerAttr(
+                                          builder.getI1Type(),
+                                          tok.kind == Tok::True))});
+    case Tok::Int:
+    case Tok::Hex:
+    case Tok::Float:
+    case Tok::HexFloat:
+      return number();
+    case Tok::String:
+    case Tok::LongString:
+      return string();
+    case Tok::Ellipsis:
+      error("elipsis not implemented");
+    case Tok::Function:
+      consume();
+      return funcbody(loc);
+    case Tok::LBrace:
+      return tableconstructor();
+    case Tok::Name:
+    case Tok::LParen: {
+      bool isVar;
+      return prefixexp(allowPack, isVar);
+    }
+    case Tok::Not:
+    case Tok::Hash:
+    case Tok::Minus:
+    case Tok::Tilde: {
+      consume();
+      Value val = exp(/*allowPack=*/false, Unary);
+      return createVal(ops.unary, loc, {val},
+                       {attr("op", builder.getStringAttr(tok.text))});
+    }
+    default:
+      error("unexpected symbol near '" +
+            (tok.kind == Tok::Eof ? "<eof>" : tok.text.str()) + "'");
+    }
+  }
+
+  Value number() {
+    const Token &tok = consume();
+    auto loc = getLoc(tok);
+    std::string text = tok.text.str();
+    Attribute value;
+    switch (tok.kind) {
+    case Tok::Int: {
+      // Decimal integers that overflow are floats, as in Lua.
+      errno = 0;
+      auto iv = std::strtoll(text.c_str(), nullptr, 10);
+      if (errno == ERANGE)
+        value = builder.getF64FloatAttr(std::strtod(text.c_str(), nullptr));
+      else
+        value = builder.getI64IntegerAttr(iv);
+      break;
+    }
+    case Tok::Hex: {
+      // Hexadecimal integers wrap around, as in Lua.
+      uint64_t uv = 0;
+      for (char c : tok.text.drop_front(2))
+        uv = uv * 16 + llvm::hexDigitValue(c);
+      value = builder.getI64IntegerAttr(int64_t(uv));
+      break;
+    }
+    case Tok::Float:
+      value = builder.getF64FloatAttr(std::strtod(text.c_str(), nullptr));
+      break;
+    default:
+      error(tok, "number HEX_FLOAT not implemented");
+    }
+    return createVal(ops.number, loc, {}, {attr("value", value)});
+  }
+
+  Value string() {
+    const Token &tok = consume();
+    if (tok.kind == Tok::LongString)
+      error(tok, "long strings not implemented");
+    return getString(unescape(tok), getLoc(tok));
+  }
+
+  /// Decode the escape sequences of a quoted string. Escapes of single bytes
+  /// above 0x7f are not implemented, since the string attribute holds UTF-8.
+  std::string unescape(const Token &tok) {
+    StringRef text = tok.text.drop_front().drop_back();
+    std::string out;
+    auto appendByte = [&](unsigned byte) {
+      if (byte > 0x7f)
+        error(tok, "non-ASCII byte escapes not implemented");
+      out += char(byte);
+    };
+    for (size_t i = 0; i < text.size();) {
+      char c = text[i++];
+      if (c != '\\') {
+        out += c;
+        continue;
+      }
+      c = text[i++];
+      switch (c) {
+      case 'a': out += '\a'; break;
+      case 'b': out += '\b'; break;
+      case 'f': out += '\f'; break;
+      case 'n': out += '\n'; break;
+      case 'r': out += '\r'; break;
+      case 't': out += '\t'; break;
+      case 'v': out += '\v'; break;
+      case '\\':
+      case '"':
+      case '\'':
+        out += c;
+        break;
+      case '\r':
+      case '\n':
+        // An escaped line break, where \r\n and \n\r count as one.
+        out += '\n';
+        if (i < text.size() && (text[i] == '\r' || text[i] == '\n') &&
+            text[i] != c)
+          ++i;
+        break;
+      case 'z':
+        while (i < text.size() && std::isspace((unsigned char) text[i]))
+          ++i;
+        break;
+      case 'x':
+        if (i + 2 > text.size() || !llvm::isHexDigit(text[i]) ||
+            !llvm::isHexDigit(text[i + 1]))
+          error(tok, "hexadecimal digit expected");
+        appendByte(llvm::hexDigitValue(text[i]) * 16 +
+                   llvm::hexDigitValue(text[i + 1]));
+        i += 2;
+        break;
+      case 'u': {
+        if (i >= text.size() || text[i] != '{')
+          error(tok, "missing '{' in \\u{xxxx}");
+        uint64_t code = 0;
+        auto start = ++i;
+        for (; i < text.size() && llvm::isHexDigit(text[i]); ++i) {
+          code = code * 16 + llvm::hexDigitValue(text[i]);
+          if (code > 0x10ffff)
+            error(tok, "UTF-8 value too large");
+        }
+        if (i == start || i >= text.size() || text[i] != '}')
+          error(tok, "missing '}' in \\u{xxxx}");
+        ++i;
+        char utf8[UNI_MAX_UTF8_BYTES_PER_CODE_POINT];
+        char *end = utf8;
+        llvm::ConvertCodePointToUTF8(code, end);
+        out.append(utf8, end);
+        break;
+      }
+      default: {
+        if (!llvm::isDigit(c))
+          error(tok, "invalid escape sequence");
+        unsigned byte = c - '0';
+        for (int n = 1; n < 3 && i < text.size() && llvm::isDigit(text[i]);
+             ++n)
+          byte = byte * 10 + (text[i++] - '0');
+        if (byte > 0xff)
+          error(tok, "decimal escape too large");
+        appendByte(byte);
+      }
+      }
+    }
+    return out;
+  }
+
+  Value tableconstructor() {
+    auto loc = getLoc(expect(Tok::LBrace, "{"));
+    Value tbl = createVal(ops.table, loc);
+    int64_t idx = 1;
+    while (!at(Tok::RBrace)) {
+      Token fieldTok = cur();
+      auto floc = getLoc(fieldTok);
+      Value key, val;
+      if (accept(Tok::LBracket)) {
+        key = exp();
+        expect(Tok::RBracket, "]");
+        expect(Tok::Assign, "=");
+        val = exp();
+      } else if (at(Tok::Name) && peek(1).kind == Tok::Assign) {
+        key = getString(consume().text, floc);
+        consume();
+        val = exp();
+      } else {
+        key = createVal(ops.number, floc, {},
+                        {attr("value", builder.getF64FloatAttr(idx++))});
+        val = exp();
+      }
+      create(ops.table_set, floc, {tbl, key, val}, {});
+      if (!accept(Tok::Comma) && !accept(Tok::Semi))
+        break;
+    }
+    expect(Tok::RBrace, "}");
+    return tbl;
+  }
+
+  /// Parse `'(' parlist? ')' block 'end'` into a `lua.function_def` at
+  /// `loc`, the start of the definition.
+  Value funcbody(Location loc) {
+    expect(Tok::LParen, "(");
+    SmallVector<Attribute, 4> params;
+    if (!at(Tok::RParen)) {
+      do {
+        if (at(Tok::Ellipsis))
+          error("variadic functions unsupported");
+        params.push_back(
+            builder.getStringAttr(expect(Tok::Name, "<name>").text));
+      } while (accept(Tok::Comma));
+    }
+    expect(Tok::RParen, ")");
+
+    auto *fcnDef = create(ops.function_def, loc, {}, {valType},
+                          {attr("params", builder.getArrayAttr(params))}, 1);
+    pushBlock(addEntryBlock(fcnDef->getRegion(0), params.size()));
+    block();
+    SmallVector<Value, 4> vals, tail;
+    retstat(vals, tail);
+    makeConcat(ops.ret, vals, tail, getLoc(expect(Tok::End, "end")));
+    popBlock();
+    return fcnDef->getResult(0);
+  }
+
+  static bool startsArgs(Tok kind) {
+    return kind == Tok::LParen || kind == Tok::LBrace ||
+           kind == Tok::String || kind == Tok::LongString;
+  }
+
+  static bool startsSuffix(Tok kind) {
+    return startsArgs(kind) || kind == Tok::Dot || kind == Tok::LBracket ||
+           kind == Tok::Colon;
+  }
+
+  Value args() {
+    auto loc = getLoc(cur());
+    if (accept(Tok::LParen)) {
+      if (accept(Tok::RParen))
+        return makeConcat(ops.concat, {}, {}, loc)->getResult(0);
+      Value pack = explist();
+      expect(Tok::RParen, ")");
+      return pack;
+    }
+    Value val = at(Tok::LBrace) ? tableconstructor() : string();
+    return makeConcat(ops.concat, {val}, {}, loc)->getResult(0);
+  }
+
+  /// Parse a prefix expression: a name or a parenthesized expression followed
+  /// by calls and indexing. `isVar` is set if it ends in a name or an index,
+  /// i.e. it can be assigned to.
+  ///
+  /// In Lua.g4, calls before an index belong to the `varSuffix` of that
+  /// index and are located at its start, while trailing calls belong to the
+  /// `prefixexp` and are located at its start. Which one a call is only
+  /// becomes known later, so calls are relocated once the chain ends.
+  Value prefixexp(bool allowPack, bool &isVar) {
+    Token start = cur();
+    Value val;
+    bool isExp = false;
+    if (at(Tok::Name)) {
+      val = createVal(ops.get_or_alloc, getLoc(start), {},
+                      {attr("var", builder.getStringAttr(consume().text))});
+      isVar = true;
+    } else {
+      expect(Tok::LParen, "(");
+      val = exp();
+      expect(Tok::RParen, ")");
+      isExp = true;
+      isVar = false;
+    }
+
+    auto suffixLoc = getLoc(cur());
+    SmallVector<Operation *, 4> calls;
+    for (;;) {
+      if (at(Tok::Dot) || at(Tok::LBracket)) {
+        if (isExp)
+          error(start, "expression variables unsupported");
+        Value key;
+        if (accept(Tok::LBracket)) {
+          key = exp();
+          expect(Tok::RBracket, "]");
+        } else {
+          consume();
+          key = getString(expect(Tok::Name, "<name>").text, suffixLoc);
+        }
+        val = createVal(ops.table_get, suffixLoc, {val, key});
+        isVar = true;
+        calls.clear();
+        suffixLoc = getLoc(cur());
+      } else if (at(Tok::Colon)) {
+        error("colon operator unimplemented");
+      } else if (startsArgs(cur().kind)) {
+        Value argPack = args();
+        auto *call = create(ops.call, suffixLoc, {val, argPack}, {packType});
+        calls.push_back(call);
+        val = call->getResult(0);
+        isVar = false;
+        // The last call of an expression yields its whole pack only if it
+        // is the last of an explist.
+        bool unpackLast = !allowPack || binaryPrec(cur().kind) != NoPrec ||
+                          at(Tok::Comma);
+        if (startsSuffix(cur().kind) || unpackLast) {
+          auto *unpackOp = create(ops.unpack, suffixLoc, {val}, {valType});
+          calls.push_back(unpackOp);
+          val = unpackOp->getResult(0);
+        }
+      } else {
+        break;
+      }
+    }
+    for (auto *op : calls)
+      op->setLoc(getLoc(start));
+    return val;
+  }
+};
+
+/// Resolve the ops the frontend emits through the dynamic dialect, so a
+/// lua.mlir out of sync with the frontend fails up front.
+static LogicalResult lookupOps(DynamicDialect *dialect, LuaOps &ops) {
+  MLIRContext *ctx = dialect->getContext();
+  auto lookup = [&](OperationName &name, StringRef opName) {
+    auto *op = dialect->lookupOp(OperationName{"lua." + opName.str(), ctx});
+    if (!op) {
+      llvm::errs() << "lua dialect has no op 'lua." << opName << "'\n";
+      return false;
+    }
+    name = OperationName{op->getOpInfo()};
+    return true;
+  };
+  bool ok = lookup(ops.concat, "concat") && lookup(ops.unpack, "unpack") &&
+      lookup(ops.alloc_local, "alloc_local") &&
+      lookup(ops.get_or_alloc, "get_or_alloc") &&
+      lookup(ops.assign, "assign") && lookup(ops.call, "call") &&
+      lookup(ops.nil, "nil") && lookup(ops.boolean, "boolean") &&
+      lookup(ops.number, "number") && lookup(ops.table, "table") &&
+      lookup(ops.table_get, "table_get") &&
+      lookup(ops.table_set, "table_set") &&
+      lookup(ops.get_string, "get_string") &&
+      lookup(ops.binary, "binary") && lookup(ops.unary, "unary") &&
+      lookup(ops.numeric_for, "numeric_for") &&
+      lookup(ops.generic_for, "generic_for") &&
+      lookup(ops.function_def, "function_def") &&
+      lookup(ops.cond_if, "cond_if") &&
+      lookup(ops.loop_while, "loop_while") &&
+      lookup(ops.repeat, "repeat") && lookup(ops.until, "until") &&
+      lookup(ops.end, "end") && lookup(ops.ret, "ret") &&
+      lookup(ops.cond, "cond");
+  return success(ok);
+}
+
+static Type lookupType(DynamicDialect *dialect, StringRef name) {
+  auto *impl = dialect->lookupType(name);
+  if (!impl) {
+    llvm::errs() << "lua dialect has no type '!lua." << name << "'\n";
+    return {};
+  }
+  return DynamicType::get(impl, {});
+}
+
+} // end anonymous namespace
+
+int main(int argc, char *argv[]) {
+  StringRef usage = "Usage: luac <dialect_mlir> <lua_file> [-o <out_mlir>] "
+                    "[--time]\n";
+  std::vector<StringRef> positional;
+  StringRef outFile = "-";
+  bool reportTime = false;
+  for (int i = 1; i < argc; ++i) {
+    StringRef arg = argv[i];
+    if (arg == "-o" && i + 1 < argc)
+      outFile = argv[++i];
+    else if (arg == "--time")
+      reportTime = true;
+    else
+      positional.push_back(arg);
+  }
+  if (positional.size() != 2) {
+    llvm::errs() << usage;
+    return -1;
+  }
+  StringRef dialectFile = positional[0], luaFile = positional[1];
+
+  MLIRContext ctx;
+  auto *dynCtx = ctx.getOrCreateDialect<DynamicContext>();
+  SourceMgr dialectSrcMgr;
+  SourceMgrDiagnosticHandler dialectDiag{dialectSrcMgr, &ctx};
+  auto dialectModule = mlir::parseSourceFile(dialectFile, dialectSrcMgr, &ctx);
+  if (!dialectModule) {
+    llvm::errs() << "Failed to load dialect module: " << dialectFile << "\n";
+    return -1;
+  }
+  if (failed(registerAllDialects(*dialectModule, dynCtx))) {
+    llvm::errs() << "Failed to register dynamic dialects\n";
+    return -1;
+  }
+  auto *dialect =
+      dynamic_cast<DynamicDialect *>(ctx.getRegisteredDialect("lua"));
+  LuaOps ops;
+  if (!dialect || failed(lookupOps(dialect, ops))) {
+    llvm::errs() << "Failed to find the lua dialect in: " << dialectFile
+                 << "\n";
+    return -1;
+  }
+  Type valType = lookupType(dialect, "val");
+  Type packType = lookupType(dialect, "pack");
+  if (!valType || !packType)
+    return -1;
+
+  auto source = MemoryBuffer::getFile(luaFile);
+  if (!source) {
+    llvm::errs() << "Failed to read Lua file: " << luaFile << "\n";
+    return -1;
+  }
+
+  using Clock = std::chrono::steady_clock;
+  auto start = Clock::now();
+  ModuleWriter writer{dynCtx};
+  try {
+    auto toks = Lexer{(*source)->getBuffer()}.lexAll();
+    Generator{&ctx, luaFile, std::move(toks), valType, packType, ops}
+        .chunk(writer);
+  } catch (const SyntaxError &err) {
+    llvm::errs() << luaFile << ":" << err.line << ":" << err.col
+                 << ": error: " << err.msg << "\n";
+    return 1;
+  }
+  std::chrono::duration<double> parseTime = Clock::now() - start;
+
+  auto module = writer.getModule();
+  if (failed(verify(module))) {
+    llvm::errs() << "Generated module failed to verify\n";
+    return -1;
+  }
+
+  start = Clock::now();
+  std::error_code ec;
+  raw_fd_ostream os{outFile, ec, sys::fs::OF_Text};
+  if (ec) {
+    llvm::errs() << "Failed to open " << outFile << ": " << ec.message()
+                 << "\n";
+    return -1;
+  }
+  module.print(os);
+  os << "\n";
+  os.flush();
+  std::chrono::duration<double> printTime = Clock::now() - start;
+
+  if (reportTime) {
+    llvm::errs() << "parse+emit: " << format("%.3f", parseTime.count())
+                 << "s, print: " << format("%.3f", printTime.count())
+                 << "s\n";
+  }
+  module.erase();
+  return 0;
+}
@@ -0,0 +1,426 @@
+#include "impl.h"
+
+#include <algorithm>
+#include <array>
+#include <csetjmp>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#include <pthread.h>
+
+/// The luac runtime heap: a non-moving mark-sweep collector.
+///
+/// Small objects are carved out of fixed-size chunks with a bump pointer, one
+/// chunk list per size class, and swept cells are reused through per-class
+/// free lists. Large objects are allocated with malloc.
+///
+/// Lowered code keeps Lua values in stack slots and passes them around by
+/// pointer, so there are no precise stack maps. Roots are instead found by
+/// conservatively scanning the native stack, the spilled registers and the
+/// registered root ranges (the call pack buffers set up by `main`). Any word
+/// that points into a live object keeps it alive. Objects reachable from
+/// tables and closures are traced precisely. The mutator is assumed to be
+/// single-threaded.
+
+namespace lua {
+namespace {
+
+struct GCHeader {
+  GCKind kind;
+  bool marked;
+  /// Size class index, or LARGE.
+  uint8_t sizeClass;
+  uint8_t padding;
+  /// Number of slots in a capture pack.
+  uint32_t count;
+
+  void *payload() { return this + 1; }
+};
+static_assert(sizeof(GCHeader) == 8, "expected 8-byte object header");
+
+GCHeader *header_of(void *obj) { return static_cast<GCHeader *>(obj) - 1; }
+
+constexpr std::array<std::size_t, 10> CELL_SIZES = {
+    16, 32, 48, 64, 96, 128, 192, 256, 320, 512};
+constexpr uint8_t LARGE = 0xff;
+constexpr std::size_t CHUNK_SIZE = 256 * 1024;
+constexpr std::size_t MIN_THRESHOLD = 4 * 1024 * 1024;
+
+struct Chunk {
+  char *base;
+  std::size_t cellSize;
+  /// Bytes handed out by the bump pointer so far.
+  std::size_t used;
+};
+
+struct LargeObject {
+  GCHeader *header;
+  std::size_t bytes;
+};
+
+struct FreeCell {
+  FreeCell *next;
+};
+
+const char *get_stack_top() {
+#if defined(__APPLE__)
+  return static_cast<const char *>(pthread_get_stackaddr_np(pthread_self()));
+#else
+  pthread_attr_t attr;
+  void *addr;
+  std::size_t size;
+  pthread_getattr_np(pthread_self(), &attr);
+  pthread_attr_getstack(&attr, &addr, &size);
+  pthread_attr_destroy(&attr);
+  return static_cast<const char *>(addr) + size;
+#endif
+}
+
+class Heap {
+public:
+  Heap() : stackTop{get_stack_top()} {
+    if (std::getenv("LUAC_GC_STATS"))
+      std::atexit([] { get().printStats(); });
+  }
+
+  static Heap &get() {
+    // Never destroyed: builtins and atexit handlers may still touch the heap.
+    static Heap &heap = *new Heap;
+    return heap;
+  }
+
+  void *alloc(GCKind kind, std::size_t bytes) {
+    if (totalBytes() + bytes > threshold)
+      collect();
+
+    auto total = bytes + sizeof(GCHeader);
+    auto cls = std::lower_bound(CELL_SIZES.begin(), CELL_SIZES.end(), total);
+    GCHeader *header;
+    if (cls == CELL_SIZES.end()) {
+      header = static_cast<GCHeader *>(std::malloc(total));
+      header->sizeClass = LARGE;
+      large.push_back({header, total});
+      bytesInUse += total;
+    } else {
+      auto idx = cls - CELL_SIZES.begin();
+      header = allocCell(idx);
+      header->sizeClass = idx;
+      bytesInUse += *cls;
+    }
+    header->kind = kind;
+    header->marked = false;
+    header->count = 0;
+    peakBytes = std::max(peakBytes, totalBytes());
+    return header->payload();
+  }
+
+  void account(std::ptrdiff_t bytes) {
+    externalBytes += bytes;
+    peakBytes = std::max(peakBytes, totalBytes());
+  }
+
+  void fix(void *obj) { fixed.push_back(header_of(obj)); }
+
+  void addRoot(const void *begin, std::size_t bytes) {
+    roots.push_back({static_cast<const char *>(begin), bytes});
+  }
+
+  void markValue(TObject val) {
+    switch (lua_get_type(val)) {
+    case STR:
+    case TBL:
+    case FCN:
+      if (auto *impl = lua_get_impl(val))
+        mark(header_of(impl));
+      break;
+#ifdef LUAC_NAN_BOXING
+    case INT:
+      if (lua_nb_has_pointer(val))
+        mark(header_of(reinterpret_cast<void *>(val.bits &
+                                                LUA_NB_PAYLOAD_MASK)));
+      break;
+#endif
+    default:
+      break;
+    }
+  }
+
+  void collect() {
+    ++collections;
+    std::sort(large.begin(), large.end(),
+              [](const LargeObject &lhs, const LargeObject &rhs) {
+                return lhs.header < rhs.header;
+              });
+
+    for (auto *header : fixed)
+      mark(header);
+    for (auto &root : roots)
+      scanRange(root.first, root.first + root.second);
+    scanStack();
+    propagate();
+    sweep();
+
+    threshold = std::max(MIN_THRESHOLD, 2 * totalBytes());
+  }
+
+private:
+  /// Heap cells plus the memory they own outside the heap.
+  std::size_t totalBytes() const { return bytesInUse + externalBytes; }
+
+  GCHeader *allocCell(std::size_t cls) {
+    if (auto *cell = freeLists[cls]) {
+      freeLists[cls] = cell->next;
+      return header_of(cell);
+    }
+    auto cellSize = CELL_SIZES[cls];
+    auto *chunk = current[cls];
+    if (!chunk || chunk->used + cellSize > CHUNK_SIZE) {
+      chunk = new Chunk{static_cast<char *>(std::malloc(CHUNK_SIZE)),
+                        cellSize, 0};
+      auto it = std::upper_bound(chunks.begin(), chunks.end(), chunk,
+                                 [](Chunk *lhs, Chunk *rhs) {
+                                   return lhs->base < rhs->base;
+                                 });
+      chunks.insert(it, chunk);
+      current[cls] = chunk;
+    }
+    auto *header = reinterpret_cast<GCHeader *>(chunk->base + chunk->used);
+    chunk->used += cellSize;
+    return header;
+  }
+
+  /// Map an arbitrary word to the live object containing it, if any.
+  GCHeader *findObject(uintptr_t word) {
+    auto *ptr = reinterpret_cast<char *>(word);
+    auto chunkIt = std::upper_bound(chunks.begin(), chunks.end(), ptr,
+                                    [](char *ptr, Chunk *chunk) {
+                                      return ptr < chunk->base;
+                                    });
+    if (chunkIt != chunks.begin()) {
+      auto *chunk = *std::prev(chunkIt);
+      std::size_t offset = ptr - chunk->base;
+      if (offset < chunk->used) {
+        auto *header = reinterpret_cast<GCHeader *>(
+            chunk->base + offset / chunk->cellSize * chunk->cellSize);
+        return header->kind == GCKind::Free ? nullptr : header;
+      }
+    }
+    auto largeIt = std::upper_bound(large.begin(), large.end(), ptr,
+                                    [](char *ptr, const LargeObject &obj) {
+                                      return ptr < (char *) obj.header;
+                                    });
+    if (largeIt != large.begin()) {
+      auto &obj = *std::prev(largeIt);
+      if (ptr < (char *) obj.header + obj.bytes)
+        return obj.header;
+    }
+    return nullptr;
+  }
+
+  void mark(GCHeader *header) {
+    if (header->marked)
+      return;
+    header->marked = true;
+    if (header->kind != GCKind::String && header->kind != GCKind::Integer)
+      markStack.push_back(header);
+  }
+
+  void markConservative(uintptr_t word) {
+#ifdef LUAC_NAN_BOXING
+    // Boxed references carry a type tag in the top bits.
+    TObject val{word};
+    if (lua_nb_has_pointer(val))
+      word = val.bits & LUA_NB_PAYLOAD_MASK;
+#endif
+    if (auto *header = findObject(word))
+      mark(header);
+  }
+
+  void scanRange(const char *begin, const char *end) {
+    auto addr = reinterpret_cast<uintptr_t>(begin);
+    addr = (addr + sizeof(uintptr_t) - 1) & ~(sizeof(uintptr_t) - 1);
+    for (; addr + sizeof(uintptr_t) <= reinterpret_cast<uintptr_t>(end);
+         addr += sizeof(uintptr_t))
+      markConservative(*reinterpret_cast<const uintptr_t *>(addr));
+  }
+
+  __attribute__((noinline)) void scanStack() {
+    // Spill callee-saved registers so pointers held only in registers are
+    // seen by the scan.
+    std::jmp_buf regs;
+    setjmp(regs);
+    auto *begin = reinterpret_cast<const char *>(&regs);
+    scanRange(begin, begin + sizeof(regs));
+    scanRange(static_cast<const char *>(__builtin_frame_address(0)), stackTop);
+  }
+
+  void propagate() {
+    while (!markStack.empty()) {
+      auto *header = markStack.back();
+      markStack.pop_back();
+      switch (header->kind) {
+      case GCKind::Table:
+        gc_trace_table(header->payload());
+        break;
+      case GCKind::Closure: {
+        auto *closure = static_cast<TClosure *>(header->payload());
+        if (closure->capture)
+          mark(header_of(closure->capture));
+        break;
+      }
+      case GCKind::Capture: {
+        // Capture slots point at the captured variables' stack slots, which
+        // may belong to frames that have returned, so treat them
+        // conservatively.
+        auto **slots = static_cast<TObject **>(header->payload());
+        for (uint32_t i = 0; i < header->count; ++i) {
+          if (!slots[i])
+            continue;
+#ifdef LUAC_NAN_BOXING
+          // Decoding a stale slot could dereference a dead integer box.
+          markConservative(slots[i]->bits);
+#else
+          markConservative(lua_get_value_union(*slots[i]));
+#endif
+        }
+        break;
+      }
+      default:
+        break;
+      }
+    }
+  }
+
+  void finalize(GCHeader *header) {
+    switch (header->kind) {
+    case GCKind::Table:
+      gc_finalize_table(header->payload());
+      break;
+    case GCKind::String:
+      gc_finalize_string(header->payload());
+      break;
+    default:
+      break;
+    }
+  }
+
+  void sweep() {
+    bytesInUse = 0;
+    for (auto *chunk : chunks) {
+      auto cls = std::find(CELL_SIZES.begin(), CELL_SIZES.end(),
+                           chunk->cellSize) - CELL_SIZES.begin();
+      for (std::size_t offset = 0; offset < chunk->used;
+           offset += chunk->cellSize) {
+        auto *header = reinterpret_cast<GCHeader *>(chunk->base + offset);
+        if (header->kind == GCKind::Free)
+          continue;
+        if (header->marked) {
+          header->marked = false;
+          bytesInUse += chunk->cellSize;
+          continue;
+        }
+        finalize(header);
+        header->kind = GCKind::Free;
+        auto *cell = static_cast<FreeCell *>(header->payload());
+        cell->next = freeLists[cls];
+        freeLists[cls] = cell;
+      }
+    }
+    auto liveEnd = std::partition(large.begin(), large.end(),
+                                  [](const LargeObject &obj) {
+                                    return obj.header->marked;
+                                  });
+    for (auto it = liveEnd; it != large.end(); ++it) {
+      finalize(it->header);
+      std::free(it->header);
+    }
+    large.erase(liveEnd, large.end());
+    for (auto &obj : large) {
+      obj.header->marked = false;
+      bytesInUse += obj.bytes;
+    }
+  }
+
+  void printStats() {
+    std::cerr << "gc: " << collections << " collections, "
+              << totalBytes() << " bytes in use, "
+              << peakBytes << " bytes peak" << std::endl;
+  }
+
+  const char *stackTop;
+
+  std::vector<Chunk *> chunks;
+  std::array<Chunk *, CELL_SIZES.size()> current{};
+  std::array<FreeCell *, CELL_SIZES.size()> freeLists{};
+  std::vector<LargeObject> large;
+
+  std::vector<GCHeader *> fixed;
+  std::vector<std::pair<const char *, std::size_t>> roots;
+  std::vector<GCHeader *> markStack;
+
+  std::size_t bytesInUse = 0;
+  /// Bytes reported through `gc_account`, e.g. table array and hash parts.
+  std::size_t externalBytes = 0;
+  std::size_t peakBytes = 0;
+  std::size_t threshold = MIN_THRESHOLD;
+  std::size_t collections = 0;
+};
+
+} // end anonymous namespace
+
+void *gc_alloc(GCKind kind, std::size_t bytes) {
+  return Heap::get().alloc(kind, bytes);
+}
+
+void gc_account(std::ptrdiff_t bytes) {
+  Heap::get().account(bytes);
+}
+
+void gc_fix(void *obj) {
+  Heap::get().fix(obj);
+}
+
+void gc_mark_value(TObject val) {
+  Heap::get().markValue(val);
+}
+
+void gc_add_root(const void *begin, std::size_t bytes) {
+  Heap::get().addRoot(begin, bytes);
+}
+
+void gc_collect() {
+  Heap::get().collect();
+}
+
+TClosure *new_closure(lua_fcn_t addr, TCapture capture) {
+  return new (gc_alloc(GCKind::Closure, sizeof(TClosure)))
+      TClosure{addr, capture};
+}
+
+} // end namespace lua
+
+extern "C" {
+
+TCapture lua_new_capture(int32_t size) {
+  auto bytes = size * sizeof(TObject *);
+  auto *slots = static_cast<TObject **>(
+      lua::gc_alloc(lua::GCKind::Capture, bytes));
+  std::fill(slots, slots + size, nullptr);
+  lua::header_of(slots)->count = size;
+  return reinterpret_cast<TCapture>(slots);
+}
+
+#ifdef LUAC_NAN_BOXING
+int64_t *lua_new_int_box(int64_t iv) {
+  return new (lua::gc_alloc(lua::GCKind::Integer, sizeof(int64_t)))
+      int64_t{iv};
+}
+#endif
+
+void lua_gc_add_root(uint64_t addr, uint64_t bytes) {
+  lua::gc_add_root(reinterpret_cast<const void *>(addr), bytes);
+}
+
+}
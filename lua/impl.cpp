@@ -1,54 +1,189 @@
 #include "lib.h"
 #include "impl.h"
 
-#include <vector>
-#include <unordered_map>
+#include <algorithm>
 #include <array>
-#include <iostream>
 #include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
 
+#ifdef LUAC_NAN_BOXING
+static_assert(sizeof(TObject) == 8, "expected TObject to be 8 bytes");
+static_assert(sizeof(void *) == 8, "NaN boxing requires 64-bit pointers");
+#else
 static_assert(sizeof(TObject) == 16, "expected TObject to be 16 bytes");
+#endif
 
 extern "C" void print_one(TObject *val);
 
 namespace lua {
 namespace {
 
+std::size_t hash_bytes(const char *data, std::size_t len) {
+  return std::hash<std::string_view>{}(std::string_view{data, len});
+}
+
+LuaString *alloc_string(const char *data, std::size_t len, std::size_t hash,
+                        bool has_hash) {
+  // Keep a trailing NUL so the bytes can be handed to C APIs.
+  auto *mem = gc_alloc(GCKind::String, sizeof(LuaString) + len + 1);
+  auto *str = new (mem) LuaString{len, hash, has_hash};
+  auto *bytes = reinterpret_cast<char *>(str + 1);
+  std::memcpy(bytes, data, len);
+  bytes[len] = '\0';
+  return str;
+}
+
+/// The set of interned short strings, using open addressing with linear
+/// probing. The table does not keep strings alive: the collector removes
+/// strings from it as they are freed.
+class StringTable {
+public:
+  LuaString *intern(const char *data, std::size_t len) {
+    auto hash = hash_bytes(data, len);
+    if (!slots.empty()) {
+      auto mask = slots.size() - 1;
+      for (auto i = hash & mask; slots[i]; i = (i + 1) & mask) {
+        auto *str = slots[i];
+        if (str->hash == hash && str->len == len &&
+            std::memcmp(str->data(), data, len) == 0)
+          return str;
+      }
+    }
+    // Allocating can run a collection, which erases freed strings and shifts
+    // the probe sequences, so only look for the free slot afterwards.
+    auto *str = alloc_string(data, len, hash, true);
+    if (2 * (count + 1) > slots.size())
+      grow();
+    auto mask = slots.size() - 1;
+    auto i = hash & mask;
+    while (slots[i])
+      i = (i + 1) & mask;
+    slots[i] = str;
+    ++count;
+    return str;
+  }
+
+  void erase(LuaString *str) {
+    auto mask = slots.size() - 1;
+    auto i = str->hash & mask;
+    while (slots[i] != str)
+      i = (i + 1) & mask;
+    // Backward-shift deletion: move later entries of the probe sequence into
+    // the hole unless their home slot lies cyclically in (i, j].
+    for (auto j = (i + 1) & mask; slots[j]; j = (j + 1) & mask) {
+      auto home = slots[j]->hash & mask;
+      if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+        continue;
+      slots[i] = slots[j];
+      i = j;
+    }
+    slots[i] = nullptr;
+    --count;
+  }
+
+private:
+  void grow() {
+    std::vector<LuaString *> old(std::max<std::size_t>(64, 2 * slots.size()));
+    std::swap(old, slots);
+    auto mask = slots.size() - 1;
+    for (auto *str : old) {
+      if (!str)
+        continue;
+      auto i = str->hash & mask;
+      while (slots[i])
+        i = (i + 1) & mask;
+      slots[i] = str;
+    }
+  }
+
+  std::vector<LuaString *> slots;
+  std::size_t count = 0;
+};
+
+StringTable &get_string_table() {
+  // Builtins create strings from static initializers in other translation
+  // units, so construct the table on first use.
+  static StringTable table;
+  return table;
+}
+
+} // end anonymous namespace
+
+std::size_t LuaString::get_hash() {
+  if (!has_hash) {
+    hash = hash_bytes(data(), len);
+    has_hash = true;
+  }
+  return hash;
+}
+
+bool LuaString::equal(LuaString *lhs, LuaString *rhs) {
+  if (lhs == rhs)
+    return true;
+  // Distinct short strings are never equal. Long strings compare by content.
+  if (lhs->is_short() || rhs->is_short() || lhs->len != rhs->len)
+    return false;
+  return std::memcmp(lhs->data(), rhs->data(), lhs->len) == 0;
+}
+
+LuaString *new_string(const char *data, std::size_t len) {
+  if (len <= LuaString::MAX_SHORT_LEN)
+    return get_string_table().intern(data, len);
+  return alloc_string(data, len, 0, false);
+}
+
+void gc_finalize_string(void *obj) {
+  auto *str = static_cast<LuaString *>(obj);
+  if (str->is_short())
+    get_string_table().erase(str);
+}
+
+namespace {
+
 struct LuaHash {
   std::size_t operator()(TObject val) const {
-    switch (val.type) {
+    switch (lua_get_type(val)) {
     case NIL:
       return std::hash<std::nullptr_t>{}(nullptr);
     case BOOL:
-      return std::hash<bool>{}(val.b);
+      return std::hash<bool>{}(lua_get_bool_val(val));
     case NUM:
-      return std::hash<double>{}(val.num);
+      return std::hash<double>{}(lua_get_double_val(val));
     case STR:
-      return std::hash<std::string>{}(*((std::string *) val.impl));
+      return as_string(val)->get_hash();
     default:
-      return std::hash<int64_t>{}(val.u);
+      return std::hash<uint64_t>{}(lua_get_value_union(val));
     }
   }
 };
 
 struct LuaEq {
   static bool compare(TObject lhs, TObject rhs) {
-    switch (lhs.type) {
+    switch (lua_get_type(lhs)) {
     case NIL:
       return true;
     case BOOL:
-      return lhs.b == rhs.b;
+      return lua_get_bool_val(lhs) == lua_get_bool_val(rhs);
     case NUM:
-      return lhs.num == rhs.num;
+      return lua_get_double_val(lhs) == lua_get_double_val(rhs);
     case STR:
-      return *((std::string *) lhs.impl) == *((std::string *) rhs.impl);
+      return LuaString::equal(as_string(lhs), as_string(rhs));
     default:
-      return lhs.u == rhs.u;
+      return lua_get_value_union(lhs) == lua_get_value_union(rhs);
     }
   }
 
   bool operator()(TObject lhs, TObject rhs) const {
-    return lhs.type == rhs.type && compare(lhs, rhs);
+    return lua_get_type(lhs) == lua_get_type(rhs) && compare(lhs, rhs);
   }
 };
 
@@ -57,104 +192,438 @@ using prealloc_t = std::array<TObject, PREALLOC>;
 static_assert(sizeof(prealloc_t) == PREALLOC * sizeof(TObject),
               "mismatched prealloc size");
 
+/// Integer keys are kept in the array part. Floats with an integral value are
+/// the same key as the integer, so `t[1.0]` and `t[1]` name one slot.
+TObject normalize_key(TObject key) {
+  if (lua_get_type(key) == NUM) {
+    // Range-check first: converting NaN, infinities or doubles outside the
+    // int64_t range is undefined. -2^63 is exact as a double.
+    auto num = lua_get_double_val(key);
+    constexpr auto min = (double) std::numeric_limits<int64_t>::min();
+    if (num >= min && num < -min) {
+      auto iv = (int64_t) num;
+      if ((double) iv == num)
+        return lua_make_int(iv);
+    }
+  }
+  return key;
+}
+
+bool is_nan(TObject key) {
+  return lua_get_type(key) == NUM && std::isnan(lua_get_double_val(key));
+}
+
+bool is_nil(TObject val) { return lua_get_type(val) == NIL; }
+
+[[noreturn]] void runtime_error(const char *msg) {
+  flush_output();
+  std::cerr << "error: " << msg << std::endl;
+  std::abort();
+}
+
+#ifdef LUAC_IC_STATS
+/// Inline cache hit counts, printed at exit by instrumented builds.
+struct InlineCacheStats {
+  std::size_t hits = 0;
+  std::size_t misses = 0;
+
+  InlineCacheStats() {
+    std::atexit([] { get().print(); });
+  }
+
+  static InlineCacheStats &get() {
+    static InlineCacheStats &stats = *new InlineCacheStats;
+    return stats;
+  }
+
+  void print() {
+    auto total = hits + misses;
+    std::cerr << "ic: " << hits << " hits, " << misses << " misses";
+    if (total)
+      std::cerr << " (" << 100.0 * hits / total << "% hit rate)";
+    std::cerr << std::endl;
+  }
+};
+#endif
+
+void count_inline_cache(bool hit) {
+#ifdef LUAC_IC_STATS
+  auto &stats = InlineCacheStats::get();
+  ++(hit ? stats.hits : stats.misses);
+#else
+  (void) hit;
+#endif
+}
+
+/// Number of bits of `n` rounded up to a power of two: ceil(log2(n)).
+unsigned ceil_log2(uint64_t n) {
+  unsigned log = 0;
+  while ((uint64_t{1} << log) < n)
+    ++log;
+  return log;
+}
+
+/// A Lua table, split like the reference implementation into an array part
+/// holding the keys [1, asize] and a hash part holding everything else. The
+/// first PREALLOC array slots are stored inline so that lowered code can index
+/// them directly off the table pointer (see `table_get_prealloc`); the rest of
+/// the array part lives in `trailing`.
+///
+/// The hash part uses open addressing with linear probing. Nil is never a
+/// valid key, so an empty slot is one whose key is nil. Assigning nil to a key
+/// keeps the key in place, as in reference Lua; dead keys are dropped when the
+/// table is next rehashed.
 struct LuaTable {
+  struct Node {
+    TObject key;
+    TObject val;
+  };
+
   prealloc_t prealloc;
-  //std::vector<TObject> trailing;
-  //std::unordered_map<TObject, TObject, LuaHash, LuaEq> table;
+  /// Array slots (PREALLOC, asize].
+  TObject *trailing = nullptr;
+  int64_t asize = PREALLOC;
+  /// Hash part of 2^hlog slots, or none.
+  Node *nodes = nullptr;
+  unsigned hlog = 0;
+  int64_t hcount = 0;
+
+  LuaTable() {
+    prealloc.fill(lua_nil());
+  }
+
+  ~LuaTable() {
+    free_array(trailing, asize - PREALLOC);
+    free_array(nodes, hash_capacity());
+  }
+
+  /// The array and hash parts live outside the collected heap; their bytes
+  /// are reported to it so that large tables count towards a collection.
+  template <typename T> static T *alloc_array(int64_t n) {
+    gc_account(n * sizeof(T));
+    return new T[n];
+  }
+
+  template <typename T> static void free_array(T *arr, int64_t n) {
+    if (!arr)
+      return;
+    gc_account(-n * (std::ptrdiff_t) sizeof(T));
+    delete[] arr;
+  }
+
+  int64_t hash_capacity() const { return nodes ? int64_t{1} << hlog : 0; }
+
+  TObject &array_slot(int64_t iv) {
+    return iv <= (int64_t) PREALLOC ? prealloc[iv - 1]
+                                    : trailing[iv - PREALLOC - 1];
+  }
+
+  bool in_array(TObject key) const {
+    return lua_get_type(key) == INT && lua_get_int_val(key) > 0 &&
+           lua_get_int_val(key) <= asize;
+  }
+
+  /// Fibonacci hashing: spread the key hash over the top `hlog` bits, since
+  /// integer and pointer hashes are often identity functions.
+  std::size_t main_position(TObject key) const {
+    auto h = (uint64_t) LuaHash{}(key) * 0x9e3779b97f4a7c15ull;
+    return hlog ? h >> (64 - hlog) : 0;
+  }
+
+  Node *find_node(TObject key) {
+    if (!nodes)
+      return nullptr;
+    auto mask = hash_capacity() - 1;
+    for (auto i = main_position(key);; i = (i + 1) & mask) {
+      auto &node = nodes[i];
+      if (is_nil(node.key))
+        return nullptr;
+      if (LuaEq{}(node.key, key))
+        return &node;
+    }
+  }
+
+  /// Insert a key known to be absent. The caller guarantees a free slot.
+  void raw_insert_new(TObject key, TObject val) {
+    auto mask = hash_capacity() - 1;
+    auto i = main_position(key);
+    while (!is_nil(nodes[i].key))
+      i = (i + 1) & mask;
+    nodes[i] = {key, val};
+    ++hcount;
+  }
+
+  /// Find a constant string key through a per-site inline cache holding the
+  /// hash slot the key was last found in. Short strings are interned, so a
+  /// pointer compare validates the slot; the cache also hits on other tables
+  /// that share this table's layout.
+  Node *find_node_cached(TObject key, int64_t *cache) {
+    auto idx = static_cast<uint64_t>(*cache);
+    if (idx < static_cast<uint64_t>(hash_capacity())) {
+      auto &node = nodes[idx];
+      if (lua_get_type(node.key) == STR &&
+          lua_get_impl(node.key) == lua_get_impl(key)) {
+        count_inline_cache(true);
+        return &node;
+      }
+    }
+    count_inline_cache(false);
+    auto *node = find_node(key);
+    if (node)
+      *cache = node - nodes;
+    return node;
+  }
+
+  TObject get_cached(TObject key, int64_t *cache) {
+    if (auto *node = find_node_cached(key, cache))
+      return node->val;
+    return lua_nil();
+  }
+
+  void set_cached(TObject key, TObject val, int64_t *cache) {
+    if (auto *node = find_node_cached(key, cache)) {
+      node->val = val;
+      return;
+    }
+    insert_or_assign(key, val);
+  }
 
   TObject prealloc_get_or_alloc(int64_t iv) {
     return prealloc[iv];
   }
 
-  //TObject list_get_or_alloc(int64_t iv) {
-  //  --iv;
-  //  if (iv < PREALLOC) {
-  //    return prealloc_get_or_alloc(iv);
-  //  }
-  //  iv -= PREALLOC;
-  //  if (trailing.size() <= iv) {
-  //    trailing.resize(1 + iv * 2);
-  //  }
-  //  return trailing[iv];
-  //}
-
   TObject get_or_alloc(TObject key) {
-    return prealloc_get_or_alloc(key.u - 1);
-    //if (key.type == INT) {
-    //  auto iv = key.u;
-    //  if (iv > 0) {
-    //    return list_get_or_alloc(iv);
-    //  }
-    //}
-    //if (auto it = table.find(key); it != table.end()) {
-    //  return it->second;
-    //} else {
-    //  TObject nil{NIL};
-    //  table.emplace_hint(it, key, nil);
-    //  return nil;
-    //}
+    key = normalize_key(key);
+    if (in_array(key))
+      return array_slot(lua_get_int_val(key));
+    if (auto *node = find_node(key))
+      return node->val;
+    return lua_nil();
   }
 
   void prealloc_insert_or_assign(int64_t iv, TObject val) {
     prealloc[iv] = val;
   }
 
-  //void list_insert_or_assign(int64_t iv, TObject val) {
-  //  --iv;
-  //  if (iv < PREALLOC) {
-  //    prealloc_insert_or_assign(iv, val);
-  //    return;
-  //  }
-  //  iv -= PREALLOC;
-  //  if (trailing.size() <= iv) {
-  //    trailing.resize(1 + iv * 2);
-  //  }
-  //  trailing[iv] = val;
-  //}
-
   void insert_or_assign(TObject key, TObject val) {
-    prealloc_insert_or_assign(key.u - 1, val);
-    //if (key.type == INT) {
-    //  auto iv = key.u;
-    //  if (iv > 0) {
-    //    list_insert_or_assign(iv, val);
-    //    return;
-    //  }
-    //}
-    //table.insert_or_assign(key, val);
-  }
-
-  //int64_t get_list_size() {
-  //  int64_t size = 0;
-  //  for (size_t i = 0; i < PREALLOC; ++i) {
-  //    if (prealloc[i].type != NIL) {
-  //      ++size;
-  //    } else {
-  //      return size;
-  //    }
-  //  }
-  //  for (size_t i = 0; i < trailing.size(); ++i) {
-  //    if (trailing[i].type != NIL) {
-  //      ++size;
-  //    } else {
-  //      return size;
-  //    }
-  //  }
-  //  return size;
-  //}
+    key = normalize_key(key);
+    if (in_array(key)) {
+      array_slot(lua_get_int_val(key)) = val;
+      return;
+    }
+    if (is_nil(key))
+      runtime_error("table index is nil");
+    if (is_nan(key))
+      runtime_error("table index is NaN");
+    if (auto *node = find_node(key)) {
+      node->val = val;
+      return;
+    }
+    // Assigning nil to an absent key is a no-op.
+    if (is_nil(val))
+      return;
+    // Keep the hash part at most 3/4 full so that probe sequences terminate
+    // quickly. Where reference Lua rehashes when its free list runs out, this
+    // table rehashes when the load limit is hit.
+    if (4 * (hcount + 1) > 3 * hash_capacity()) {
+      rehash(key);
+      // The key may now belong to the array part.
+      insert_or_assign(key, val);
+      return;
+    }
+    raw_insert_new(key, val);
+  }
+
+  /// Integer key counts bucketed by powers of two: nums[i] is the number of
+  /// keys k with 2^(i-1) < k <= 2^i, as in `ltable.c`.
+  static constexpr unsigned MAXABITS = 40;
+  using nums_t = std::array<int64_t, MAXABITS + 1>;
+
+  static bool count_int(TObject key, nums_t &nums) {
+    if (lua_get_type(key) != INT)
+      return false;
+    auto iv = lua_get_int_val(key);
+    if (iv <= 0 || iv > (int64_t{1} << MAXABITS))
+      return false;
+    ++nums[ceil_log2(iv)];
+    return true;
+  }
+
+  int64_t num_use_array(nums_t &nums) {
+    int64_t total = 0;
+    for (int64_t iv = 1; iv <= asize; ++iv) {
+      if (!is_nil(array_slot(iv))) {
+        ++nums[ceil_log2(iv)];
+        ++total;
+      }
+    }
+    return total;
+  }
+
+  /// Pick the largest power of two n such that more than half of the slots
+  /// [1, n] would be in use, and return it. `nint` is updated to the number of
+  /// integer keys that will land in the array part.
+  static int64_t compute_sizes(const nums_t &nums, int64_t &nint) {
+    int64_t a = 0, na = 0, optimal = 0;
+    for (unsigned i = 0; i <= MAXABITS; ++i) {
+      auto twotoi = int64_t{1} << i;
+      if (nint <= twotoi / 2)
+        break;
+      a += nums[i];
+      if (a > twotoi / 2) {
+        optimal = twotoi;
+        na = a;
+      }
+    }
+    nint = na;
+    return optimal;
+  }
+
+  void rehash(TObject extra) {
+    nums_t nums{};
+    int64_t nint = num_use_array(nums);
+    int64_t total = nint;
+    for (int64_t i = 0, e = hash_capacity(); i < e; ++i) {
+      auto &node = nodes[i];
+      if (is_nil(node.key) || is_nil(node.val))
+        continue;
+      nint += count_int(node.key, nums);
+      ++total;
+    }
+    nint += count_int(extra, nums);
+    ++total;
+    auto newAsize = compute_sizes(nums, nint);
+    resize(std::max<int64_t>(newAsize, PREALLOC), total - nint);
+  }
+
+  void resize(int64_t newAsize, int64_t nhash) {
+    auto *oldNodes = nodes;
+    auto oldCapacity = hash_capacity();
+
+    // Size the hash part so `nhash` keys fit under the 3/4 load limit.
+    if (nhash > 0) {
+      hlog = std::max(ceil_log2((4 * nhash + 2) / 3), 2u);
+      nodes = alloc_array<Node>(int64_t{1} << hlog);
+      for (int64_t i = 0, e = hash_capacity(); i < e; ++i)
+        nodes[i].key = lua_nil();
+    } else {
+      hlog = 0;
+      nodes = nullptr;
+    }
+    hcount = 0;
+
+    // Grow or shrink the array part. Array slots beyond the new size move to
+    // the hash part.
+    auto oldAsize = asize;
+    auto *oldTrailing = trailing;
+    trailing = newAsize > (int64_t) PREALLOC
+                   ? alloc_array<TObject>(newAsize - PREALLOC) : nullptr;
+    for (int64_t iv = PREALLOC + 1; iv <= newAsize; ++iv) {
+      auto &slot = trailing[iv - PREALLOC - 1];
+      if (iv <= oldAsize) {
+        slot = oldTrailing[iv - PREALLOC - 1];
+      } else {
+        slot = lua_nil();
+      }
+    }
+    asize = newAsize;
+    for (int64_t iv = newAsize + 1; iv <= oldAsize; ++iv) {
+      auto &val = oldTrailing[iv - PREALLOC - 1];
+      if (!is_nil(val))
+        insert_or_assign(lua_make_int(iv), val);
+    }
+    free_array(oldTrailing, oldAsize - PREALLOC);
+
+    // Reinsert the live hash entries.
+    for (int64_t i = 0; i < oldCapacity; ++i) {
+      auto &node = oldNodes[i];
+      if (!is_nil(node.key) && !is_nil(node.val))
+        insert_or_assign(node.key, node.val);
+    }
+    free_array(oldNodes, oldCapacity);
+  }
+
+  /// Find a border: an index n such that t[n] is not nil and t[n + 1] is nil,
+  /// or 0 if t[1] is nil. Uses the same strategy as `luaH_getn`.
+  int64_t get_list_size() {
+    if (is_nil(array_slot(asize))) {
+      // Binary search for a border in the array part.
+      int64_t i = 0, j = asize;
+      while (j - i > 1) {
+        auto m = (i + j) / 2;
+        if (is_nil(array_slot(m)))
+          j = m;
+        else
+          i = m;
+      }
+      return i;
+    }
+    if (!nodes)
+      return asize;
+    // Unbounded search in the hash part.
+    auto present = [&](int64_t iv) {
+      auto *node = find_node(lua_make_int(iv));
+      return node && !is_nil(node->val);
+    };
+    int64_t i = asize, j = asize + 1;
+    while (present(j)) {
+      i = j;
+      if (j > INT64_MAX / 2) {
+        // Pathological table: fall back to a linear search.
+        i = 1;
+        while (present(i + 1))
+          ++i;
+        return i;
+      }
+      j *= 2;
+    }
+    while (j - i > 1) {
+      auto m = (i + j) / 2;
+      if (present(m))
+        i = m;
+      else
+        j = m;
+    }
+    return i;
+  }
 };
 
+// Lowered code indexes `prealloc` directly off the table pointer.
+static_assert(std::is_standard_layout<LuaTable>::value,
+              "LuaTable must be standard layout");
+static_assert(offsetof(LuaTable, prealloc) == 0,
+              "LuaTable::prealloc must be the first member");
+
 } // end anonymous namespace
+
+void gc_trace_table(void *obj) {
+  auto *tbl = static_cast<LuaTable *>(obj);
+  for (int64_t iv = 1; iv <= tbl->asize; ++iv)
+    gc_mark_value(tbl->array_slot(iv));
+  for (int64_t i = 0, e = tbl->hash_capacity(); i < e; ++i) {
+    auto &node = tbl->nodes[i];
+    if (is_nil(node.key))
+      continue;
+    gc_mark_value(node.key);
+    gc_mark_value(node.val);
+  }
+}
+
+void gc_finalize_table(void *obj) {
+  static_cast<LuaTable *>(obj)->~LuaTable();
+}
+
 } // end namespace lua
 
 extern "C" {
 
 void *lua_make_fcn_impl(lua_fcn_t addr, TCapture capture) {
-  return new TClosure{addr, capture};
+  return lua::new_closure(addr, capture);
 }
 
 void *lua_new_table_impl(void) {
-  return (void *) new lua::LuaTable;
+  auto *mem = lua::gc_alloc(lua::GCKind::Table, sizeof(lua::LuaTable));
+  return new (mem) lua::LuaTable;
 }
 void lua_table_set_impl(void *impl, TObject key, TObject val) {
   ((lua::LuaTable *) impl)->insert_or_assign(key, val);
@@ -168,14 +637,23 @@ void lua_table_set_prealloc_impl(void *impl, int64_t iv, TObject val) {
 TObject lua_table_get_prealloc_impl(void *impl, int64_t iv) {
   return ((lua::LuaTable *) impl)->prealloc_get_or_alloc(iv);
 }
+TObject lua_table_get_cached_impl(void *impl, TObject key, int64_t *cache) {
+  return ((lua::LuaTable *) impl)->get_cached(key, cache);
+}
+void lua_table_set_cached_impl(void *impl, TObject key, TObject val,
+                               int64_t *cache) {
+  ((lua::LuaTable *) impl)->set_cached(key, val, cache);
+}
 
 int64_t lua_list_size_impl(void *impl) {
-  assert(false);
-  //return ((lua::LuaTable *) impl)->get_list_size();
+  return ((lua::LuaTable *) impl)->get_list_size();
 }
 
 void *lua_load_string_impl(const char *data, uint64_t len) {
-  return new std::string{data, len};
+  // String literals are loaded once and kept for the whole program.
+  auto *str = lua::new_string(data, len);
+  lua::gc_fix(str);
+  return str;
 }
 
 bool lua_eq_impl(TObject lhs, TObject rhs) {
@@ -184,12 +662,39 @@ bool lua_eq_impl(TObject lhs, TObject rhs) {
 }
 
 TObject lua_strcat_impl(void* lhs, void *rhs) {
-  TObject ret;
-  ret.type = STR;
-  auto catted = *((std::string *) lhs) + *((std::string *) rhs);
-  ret.impl = new std::string{std::move(catted)};
-  return ret;
+  auto lhsView = ((lua::LuaString *) lhs)->view();
+  auto rhsView = ((lua::LuaString *) rhs)->view();
+  std::string catted;
+  catted.reserve(lhsView.size() + rhsView.size());
+  catted.append(lhsView).append(rhsView);
+  return lua_make_impl(STR, lua::new_string(catted.data(), catted.size()));
+}
+
+#ifdef LUAC_NAN_BOXING
+
+// Value access for code lowered with `luac.py --nan-boxing`, which sees a value
+// as its raw bits. Setting the type resets the payload, so the type is always
+// set first.
+int32_t lua_value_get_type(uint64_t bits) {
+  return lua_get_type(TObject{bits});
+}
+uint64_t lua_value_get_u(uint64_t bits) {
+  return lua_get_value_union(TObject{bits});
+}
+void *lua_value_get_impl(uint64_t bits) {
+  return lua_get_impl(TObject{bits});
 }
+uint64_t lua_value_set_type(int32_t type) {
+  return lua_make_value(type, 0).bits;
+}
+uint64_t lua_value_set_u(uint64_t bits, uint64_t u) {
+  return lua_make_value(lua_value_get_type(bits), u).bits;
+}
+uint64_t lua_value_set_impl(uint64_t bits, void *impl) {
+  return lua_make_impl(lua_value_get_type(bits), impl).bits;
+}
+
+#endif
 
 int64_t ipow(int64_t x, int64_t p)
 {
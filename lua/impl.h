@@ -1,9 +1,85 @@
 #include "lib.h"
 
-#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
 
 namespace lua {
 
-std::string &as_std_string(TObject *val);
+/*******************************************************************************
+ * Memory Management
+ ******************************************************************************/
+
+/// Heap objects owned by the collector. Every `impl` pointer held by a string,
+/// table or function value points at one of these, as does the payload of a
+/// boxed integer in NaN-boxed builds.
+enum class GCKind : uint8_t {
+  Free,
+  String,
+  Table,
+  Closure,
+  Capture,
+  Integer,
+};
+
+/// Allocate `bytes` of collector-owned memory for an object of the given kind.
+/// May trigger a collection.
+void *gc_alloc(GCKind kind, std::size_t bytes);
+/// Report `bytes` allocated outside the heap on behalf of a collected object,
+/// or freed when negative. Counts towards the next collection but never runs
+/// one, so it is safe while the object is inconsistent.
+void gc_account(std::ptrdiff_t bytes);
+/// Exempt an object from collection, e.g. string literals and builtins.
+void gc_fix(void *obj);
+/// Mark a value reachable from a traced object.
+void gc_mark_value(TObject val);
+/// Register a range of memory outside the native stack to scan for roots.
+void gc_add_root(const void *begin, std::size_t bytes);
+/// Run a full collection.
+void gc_collect();
+
+/// Per-kind hooks implemented alongside the object types.
+void gc_trace_table(void *tbl);
+void gc_finalize_table(void *tbl);
+void gc_finalize_string(void *str);
+
+TClosure *new_closure(lua_fcn_t addr, TCapture capture);
+
+/// Immutable Lua string. The bytes follow the header in the same allocation.
+///
+/// As in reference Lua, short strings are interned: there is exactly one
+/// LuaString per short byte sequence, so equality is a pointer compare and the
+/// hash is computed once on creation. Long strings are not interned; their
+/// hash is computed the first time it is needed.
+struct LuaString {
+  /// Strings up to this length are interned (LUAI_MAXSHORTLEN).
+  static constexpr std::size_t MAX_SHORT_LEN = 40;
+
+  std::size_t len;
+  std::size_t hash;
+  bool has_hash;
+
+  const char *data() const { return reinterpret_cast<const char *>(this + 1); }
+  std::string_view view() const { return {data(), len}; }
+  bool is_short() const { return len <= MAX_SHORT_LEN; }
+  std::size_t get_hash();
+
+  static bool equal(LuaString *lhs, LuaString *rhs);
+};
+
+/// Get or create the string with the given contents.
+LuaString *new_string(const char *data, std::size_t len);
+
+/// Write out the output buffered by `print` and `io.write`. Exit handlers do
+/// not run on abort, so the runtime calls this before reporting an error.
+void flush_output();
+
+inline LuaString *as_string(TObject val) {
+  return static_cast<LuaString *>(lua_get_impl(val));
+}
+
+inline std::string_view as_string_view(TObject val) {
+  return as_string(val)->view();
+}
 
 } // end namespace lua
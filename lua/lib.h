@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,6 +38,33 @@ typedef struct Closure {
   TCapture capture;
 } TClosure;
 
+#ifdef LUAC_NAN_BOXING
+
+/// NaN-boxed value. Numbers are stored as raw IEEE doubles. Every other type
+/// lives in the 48-bit payload of a negative NaN whose top 16 bits are
+/// LUA_NB_TAG_BASE plus the type. The low tags are signaling NaN patterns and
+/// the high ones overlap the negative quiet NaNs, e.g. 0xfff8... is the NaN
+/// x86 produces for 0/0 and would decode as tag 7. Storing a NUM therefore
+/// canonicalizes every NaN to the positive quiet LUA_NB_CANONICAL_NAN, so no
+/// stored double has a tag in its top bits. Pointers fit the payload on every
+/// supported target. Integers that do not fit the payload are boxed on the
+/// heap under LUA_NB_BOXED_INT and still read as INT.
+typedef struct Object {
+  uint64_t bits;
+} TObject;
+
+#define LUA_NB_TAG_BASE 0xfff1u
+#define LUA_NB_PAYLOAD_BITS 48
+#define LUA_NB_PAYLOAD_MASK ((UINT64_C(1) << LUA_NB_PAYLOAD_BITS) - 1)
+#define LUA_NB_CANONICAL_NAN UINT64_C(0x7ff8000000000000)
+/// Type tag of an integer boxed on the heap; not a Lua type of its own.
+#define LUA_NB_BOXED_INT (INT + 1)
+
+/// Allocate a collector-owned cell holding `iv`.
+int64_t *lua_new_int_box(int64_t iv);
+
+#else
+
 typedef struct Object {
   int32_t type;
   union {
@@ -48,33 +76,120 @@ typedef struct Object {
   };
 } TObject;
 
+#endif
 
 /*******************************************************************************
  * Simple Value Manipulation
+ *
+ * The runtime only touches values through these accessors so that it builds
+ * against either value representation. `u` is the raw payload as lowered code
+ * sees it: the bits of the double for NUM, the integer for INT, the pointer
+ * for reference types.
  ******************************************************************************/
 
-TObject lua_nil(void);
+#ifdef LUAC_NAN_BOXING
+
+/// The type tag in the top bits, or NUM for a double.
+static inline int32_t lua_nb_get_tag(TObject val) {
+  uint32_t tag = (uint32_t) (val.bits >> LUA_NB_PAYLOAD_BITS);
+  return tag >= LUA_NB_TAG_BASE ? (int32_t) (tag - LUA_NB_TAG_BASE) : NUM;
+}
+
+/// Whether the payload points at a collector-owned object.
+static inline bool lua_nb_has_pointer(TObject val) {
+  int32_t tag = lua_nb_get_tag(val);
+  return tag == STR || tag == TBL || tag == FCN || tag == LUA_NB_BOXED_INT;
+}
+
+static inline int32_t lua_get_type(TObject val) {
+  int32_t tag = lua_nb_get_tag(val);
+  return tag == LUA_NB_BOXED_INT ? INT : tag;
+}
+
+static inline uint64_t lua_get_value_union(TObject val) {
+  switch (lua_nb_get_tag(val)) {
+  case NUM:
+    return val.bits;
+  case INT:
+    // Sign-extend the payload.
+    return (uint64_t) ((int64_t) (val.bits << (64 - LUA_NB_PAYLOAD_BITS)) >>
+                       (64 - LUA_NB_PAYLOAD_BITS));
+  case LUA_NB_BOXED_INT:
+    return (uint64_t) *(int64_t *) (uintptr_t) (val.bits &
+                                                 LUA_NB_PAYLOAD_MASK);
+  default:
+    return val.bits & LUA_NB_PAYLOAD_MASK;
+  }
+}
+
+static inline TObject lua_make_value(int32_t ty, uint64_t u) {
+  TObject val;
+  if (ty == NUM) {
+    // Canonicalize NaNs so that no double aliases a boxed value.
+    bool isNaN = (u & UINT64_C(0x7ff0000000000000)) ==
+                     UINT64_C(0x7ff0000000000000) &&
+                 (u & UINT64_C(0x000fffffffffffff)) != 0;
+    val.bits = isNaN ? LUA_NB_CANONICAL_NAN : u;
+    return val;
+  }
+  if (ty == INT) {
+    int64_t iv = (int64_t) u;
+    int64_t lim = INT64_C(1) << (LUA_NB_PAYLOAD_BITS - 1);
+    if (iv < -lim || iv >= lim) {
+      ty = LUA_NB_BOXED_INT;
+      u = (uint64_t) (uintptr_t) lua_new_int_box(iv);
+    }
+  }
+  val.bits = ((uint64_t) (LUA_NB_TAG_BASE + ty) << LUA_NB_PAYLOAD_BITS) |
+             (u & LUA_NB_PAYLOAD_MASK);
+  return val;
+}
+
+#else
+
+static inline int32_t lua_get_type(TObject val) { return val.type; }
+
+static inline uint64_t lua_get_value_union(TObject val) {
+  return (uint64_t) val.u;
+}
+
+static inline TObject lua_make_value(int32_t ty, uint64_t u) {
+  TObject val;
+  val.type = ty;
+  val.u = (int64_t) u;
+  return val;
+}
+
+#endif
 
-TObject lua_alloc(void);
-void lua_copy(TObject *ptr, TObject val);
+static inline bool lua_get_bool_val(TObject val) {
+  return lua_get_value_union(val) & 1;
+}
 
-int32_t lua_get_type(TObject val);
-void lua_set_type(TObject *ptr, int32_t ty);
+static inline int64_t lua_get_int_val(TObject val) {
+  return (int64_t) lua_get_value_union(val);
+}
 
-bool lua_get_bool_val(TObject val);
-void lua_set_bool_val(TObject *ptr, bool b);
+static inline double lua_get_double_val(TObject val) {
+  uint64_t u = lua_get_value_union(val);
+  double num;
+  memcpy(&num, &u, sizeof(num));
+  return num;
+}
 
-double lua_get_double_val(TObject val);
-void lua_set_double_val(TObject *ptr, double fp);
+static inline void *lua_get_impl(TObject val) {
+  return (void *) (uintptr_t) lua_get_value_union(val);
+}
 
-lua_fcn_t lua_get_fcn_addr(TObject val);
-void lua_set_fcn_addr(TObject val, lua_fcn_t fcn_addr);
+static inline TObject lua_nil(void) { return lua_make_value(NIL, 0); }
 
-TCapture lua_get_capture_pack(TObject val);
-void lua_set_capture_pack(TObject val, TCapture capture);
+static inline TObject lua_make_int(int64_t iv) {
+  return lua_make_value(INT, (uint64_t) iv);
+}
 
-uint64_t lua_get_value_union(TObject val);
-void lua_set_value_union(TObject *ptr, uint64_t u);
+static inline TObject lua_make_impl(int32_t ty, void *impl) {
+  return lua_make_value(ty, (uint64_t) (uintptr_t) impl);
+}
 
 /*******************************************************************************
  * Pack Manipulation
@@ -103,6 +218,10 @@ void lua_table_set(TObject tbl, TObject key, TObject val);
 TObject lua_list_size(TObject tbl);
 TObject lua_load_string(const char *data, uint64_t len);
 
+void *lua_new_table_impl(void);
+void lua_table_set_impl(void *impl, TObject key, TObject val);
+void *lua_load_string_impl(const char *data, uint64_t len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -316,7 +316,19 @@ module {
   func @lua_table_set_impl(!luallvm.impl, !luallvm.value, !luallvm.value)
   func @lua_table_get_prealloc_impl(!luallvm.impl, i64) -> !luallvm.value
   func @lua_table_set_prealloc_impl(!luallvm.impl, i64, !luallvm.value)
+  func @lua_table_get_cached_impl(!luallvm.impl, !luallvm.value, !llvm.ptr<i64>) -> !luallvm.value
+  func @lua_table_set_cached_impl(!luallvm.impl, !luallvm.value, !luallvm.value, !llvm.ptr<i64>)
   func @lua_make_fcn_impl(!luallvm.fcn, !luallvm.capture) -> !luallvm.impl
+  func @lua_new_capture(i32) -> !luallvm.capture
+  func @lua_gc_add_root(!llvm.i64, !llvm.i64)
   func @lua_load_string_impl(!llvm.ptr<i8>, !llvm.i64) -> !luallvm.impl
   func @lua_new_table_impl() -> !luallvm.impl
+
+  // NaN-boxed value helpers, only referenced with --nan-boxing.
+  func @lua_value_get_type(!llvm.i64) -> !luallvm.type
+  func @lua_value_get_u(!llvm.i64) -> !llvm.i64
+  func @lua_value_get_impl(!llvm.i64) -> !luallvm.impl
+  func @lua_value_set_type(!luallvm.type) -> !llvm.i64
+  func @lua_value_set_u(!llvm.i64, !llvm.i64) -> !llvm.i64
+  func @lua_value_set_impl(!llvm.i64, !luallvm.impl) -> !llvm.i64
 }
@@ -141,6 +141,11 @@ Dialect @luaopt {
   Op @table_set_prealloc(tbl: !lua.value, iv: i64, val: !lua.value) -> ()
     traits [@WriteTo<"tbl">]
 
+  // Table accesses with a constant string key, through a per-site cache
+  Op @table_get_cached(tbl: !lua.value, key: !lua.value) -> (val: !lua.value)
+  Op @table_set_cached(tbl: !lua.value, key: !lua.value, val: !lua.value) -> ()
+    traits [@WriteTo<"tbl">]
+
   Op @unpack_unsafe(pack: !lua.value_pack) -> (vals: !dmc.Variadic<!lua.value>)
     traits [@SameVariadicResultSizes, @NoSideEffects]
 
@@ -253,6 +258,7 @@ Dialect @luac {
     config { fmt = "$val `[` `]` attr-dict" }
 
   Op @new_capture(size: i32) -> (capture: !lua.capture_pack)
+  Op @alloca_capture(size: i32) -> (capture: !lua.capture_pack)
   Op @add_capture(capture: !lua.capture_pack, val: !lua.value, idx: i32) -> ()
     traits [@WriteTo<"capture">]
   Op @get_capture(capture: !lua.capture_pack, idx: i32) -> (val: !lua.value)
@@ -344,6 +350,13 @@ Dialect @luallvm {
   Op @table_set_prealloc_impl(impl: !luallvm.impl, iv: i64, val: !luallvm.value) -> ()
     traits [@WriteTo<"impl">] config { fmt = "$impl `[` $iv `]` `=` $val attr-dict" }
 
+  Op @table_get_cached_impl(impl: !luallvm.impl, key: !luallvm.value,
+                            cache: !llvm.ptr<i64>) -> (val: !luallvm.value)
+    traits [@ReadFrom<"impl">]
+  Op @table_set_cached_impl(impl: !luallvm.impl, key: !luallvm.value,
+                            val: !luallvm.value, cache: !llvm.ptr<i64>) -> ()
+    traits [@WriteTo<"impl">]
+
   Alias @type_ptr -> !llvm.ptr<i32> { builder = "LLVMType.Int32().ptr_to()" }
   Alias @u_ptr    -> !llvm.ptr<i64> { builder = "LLVMType.Int64().ptr_to()" }
   Alias @impl_ptr -> !llvm.ptr<ptr<i8>> { builder = "LLVMType.Int8Ptr().ptr_to()" }
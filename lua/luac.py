@@ -13,16 +13,42 @@ import sys
 
 cwd = os.path.dirname(os.path.realpath(__file__))
 
+# Lower values to the NaN-boxed representation. The runtime must be built with
+# LUAC_NAN_BOXING to match. Read before the dialects are registered, since it
+# changes the luallvm value type.
+NAN_BOXING = "--nan-boxing" in sys.argv[1:]
+
 ################################################################################
 # Initialization
 ################################################################################
 
 def get_dialects(filename=cwd + '/lua.mlir'):
-    m = parseSourceFile(filename)
+    if NAN_BOXING:
+        m = parseNanBoxedDialects(filename)
+    else:
+        m = parseSourceFile(filename)
     assert m, "failed to load dialects"
     dialects = registerDynamicDialects(m)
     return dialects[0], dialects[1], dialects[2], dialects[3]
 
+def parseNanBoxedDialects(filename):
+    # Only the luallvm aliases spell out the value layout, so swap the tagged
+    # { type, u } struct for a single i64 and parse the result instead.
+    import tempfile
+    with open(filename, 'r') as file:
+        contents = file.read()
+    contents = contents.replace(
+        "struct<(i32, i64)>", "struct<(i64)>").replace(
+        "LLVMType.Struct([LLVMType.Int32(), LLVMType.Int64()])",
+        "LLVMType.Struct([LLVMType.Int64()])")
+    tmp = tempfile.NamedTemporaryFile('w', suffix='.mlir', delete=False)
+    with tmp:
+        tmp.write(contents)
+    try:
+        return parseSourceFile(tmp.name)
+    finally:
+        os.remove(tmp.name)
+
 lua, luaopt, luac, luallvm = get_dialects()
 
 ################################################################################
@@ -52,6 +78,56 @@ def makeConcat(b, vals, tail, loc, concatLike=lua.concat):
         VectorType([2], I64Type(), loc), [len(vals), len(tail)]))
     return concat
 
+lua_escapes = {"a": "\a", "b": "\b", "f": "\f", "n": "\n", "r": "\r",
+               "t": "\t", "v": "\v", "\\": "\\", "\"": "\"", "'": "'"}
+
+def unescapeString(text):
+    # Escapes of single bytes above 0x7f are not implemented, since the
+    # string attribute holds UTF-8.
+    def byte(val):
+        if val > 0x7f:
+            raise NotImplementedError("non-ASCII byte escapes not implemented")
+        return chr(val)
+    out = []
+    i = 0
+    while i < len(text):
+        c = text[i]
+        i += 1
+        if c != "\\":
+            out.append(c)
+            continue
+        c = text[i]
+        i += 1
+        if c in lua_escapes:
+            out.append(lua_escapes[c])
+        elif c in "\r\n":
+            # An escaped line break, where \r\n and \n\r count as one.
+            out.append("\n")
+            if i < len(text) and text[i] in "\r\n" and text[i] != c:
+                i += 1
+        elif c == "z":
+            while i < len(text) and text[i].isspace():
+                i += 1
+        elif c == "x":
+            out.append(byte(int(text[i:i + 2], 16)))
+            i += 2
+        elif c == "u":
+            end = text.index("}", i)
+            code = int(text[i + 1:end], 16)
+            if code > 0x10ffff:
+                raise ValueError("UTF-8 value too large")
+            out.append(chr(code))
+            i = end + 1
+        else:
+            start = i - 1
+            while i < len(text) and i - start < 3 and text[i].isdigit():
+                i += 1
+            val = int(text[start:i])
+            if val > 0xff:
+                raise ValueError("decimal escape too large")
+            out.append(byte(val))
+    return "".join(out)
+
 class Generator:
     #########################################################
     # Helpers                                               #
@@ -335,11 +411,18 @@ class Generator:
 
     def number(self, ctx:LuaParser.NumberContext):
         if ctx.INT():
-            attr = I64Attr(int(ctx.INT().getText()))
+            # Decimal integers that overflow are floats, as in Lua.
+            iv = int(ctx.INT().getText())
+            if -2**63 <= iv < 2**63:
+                attr = I64Attr(iv)
+            else:
+                attr = F64Attr(float(ctx.INT().getText()))
         elif ctx.HEX():
-            attr = I64Attr(int(ctx.HEX().getText(), 16))
+            # Hexadecimal integers wrap around, as in Lua.
+            iv = int(ctx.HEX().getText(), 16) & (2**64 - 1)
+            attr = I64Attr(iv - 2**64 if iv >= 2**63 else iv)
         elif ctx.FLOAT():
-            attr = F64Attr(float(ctx.FLOAT().getText()()))
+            attr = F64Attr(float(ctx.FLOAT().getText()))
         elif ctx.HEX_FLOAT():
             raise NotImplementedError("number HEX_FLOAT not implemented")
         else:
@@ -349,7 +432,6 @@ class Generator:
         return number.res()
 
     def string(self, ctx:LuaParser.StringContext):
-        # TODO escapes and special characters unhandled
         if ctx.NORMALSTRING():
             text = ctx.NORMALSTRING().getText()
         elif ctx.CHARSTRING():
@@ -358,7 +440,7 @@ class Generator:
             raise NotImplementedError("long strings not implemented")
         else:
             raise ValueError("Unknown StringContext case")
-        text = text[1:len(text)-1]
+        text = unescapeString(text[1:len(text)-1])
         return self.builder.create(lua.get_string, value=StringAttr(text),
                                    loc=self.getStartLoc(ctx)).res()
 
@@ -600,7 +682,7 @@ class AllocVisitor:
                 self.popScope()
 
     def visitAll(self, main:FuncOp):
-        self.global_block = main.getBody().getBlock(0)
+        self.global_block = main.getRegion(0).getBlock(0)
         self.checkWork(main)
         for op in self.worklist:
             if op not in self.removed:
@@ -1011,6 +1093,257 @@ def cfExpand(module:ModuleOp, main:FuncOp):
     applyOptPatterns(module, [Pattern(luaopt.pack_func,
                                       lowerFunctionDef(module))])
 
+################################################################################
+# IR: SSA Promotion of Locals
+################################################################################
+
+# After cfExpand every function is a CFG of blocks and a local is a slot that
+# is read directly and written with `lua.copy`. A slot that is not captured
+# and only written that way is promoted: reads take the value last copied in,
+# and the values reaching a block along different edges merge in a block
+# argument. Captured slots stay in memory, since the closure shares them.
+#
+# A copy snapshots its source, so reads can only be forwarded to a source that
+# is not itself overwritten later, which is the case if it is never written
+# or is itself promoted. Arguments are first placed in every block a slot is
+# live into, then those that merge a single value are removed, which leaves
+# minimal SSA for the structured control flow Lua lowers to.
+
+def successorOperandIndices(term):
+    """Pairs of a successor of `term` and the indices of the operands it
+    forwards to the successor's arguments."""
+    if term.name == "std.br":
+        return [(term.getSuccessor(0), range(0, term.getNumOperands()))]
+    if term.name == "std.cond_br":
+        trueDest = term.getSuccessor(0)
+        nTrue = 1 + trueDest.getNumArguments()
+        return [(trueDest, range(1, nTrue)),
+                (term.getSuccessor(1), range(nTrue, term.getNumOperands()))]
+    return []
+
+def successorOperands(term):
+    return [(succ, [term.getOperand(i) for i in indices])
+            for succ, indices in successorOperandIndices(term)]
+
+def writesSlot(use, val):
+    # A table write goes through the table the slot holds, not the slot.
+    return (val in getWriteEffectingValues(use) and
+            not isa(use, lua.table_set))
+
+def isSharedSlot(val):
+    return (isa(val.definingOp, lua.get_captures) or
+            any(isa(use, lua.make_capture) for use in val.getOpUses()))
+
+def isPromotable(val):
+    if val.type != lua.val() or isSharedSlot(val):
+        return False
+    copies = 0
+    for use in val.getOpUses():
+        if not isa(use.parentOp, FuncOp):
+            return False
+        if not writesSlot(use, val):
+            continue
+        if not isa(use, lua.copy) or lua.copy(use).tgt() != val:
+            return False
+        copies += 1
+    return copies > 0
+
+def isStableSource(val, slots):
+    if val in slots:
+        return True
+    return (val.definingOp != None and not isSharedSlot(val) and
+            not any(writesSlot(use, val) for use in val.getOpUses()))
+
+def slotReads(op, slots):
+    if isa(op, lua.copy):
+        val = lua.copy(op).val()
+        return [(1, val)] if val in slots else []
+    return [(i, val) for i, val in enumerate(op.getOperands()) if val in slots]
+
+def slotWrites(op, slots):
+    if isa(op, lua.copy):
+        tgt = lua.copy(op).tgt()
+        return [tgt] if tgt in slots else []
+    return [res for res in op.getResults() if res in slots]
+
+class BlockArgPhi:
+    def __init__(self, var):
+        self.var = var
+        self.incoming = []
+        self.same = None
+        self.arg = None
+
+def resolvePhi(val):
+    while isinstance(val, BlockArgPhi) and val.same != None:
+        val = val.same
+    return val
+
+class SlotPromoter:
+    def __init__(self, func:FuncOp):
+        self.blocks = list(func.getRegion(0))
+        self.succs = {}
+        for block in self.blocks:
+            term = block.getTerminator()
+            self.succs[block] = [term.getSuccessor(i)
+                                 for i in range(term.getNumSuccessors())]
+
+    def selectSlots(self):
+        self.order = []
+        for block in self.blocks:
+            for op in block:
+                self.order += [res for res in op.getResults()
+                               if isPromotable(res)]
+        slots = set(self.order)
+        changed = True
+        while changed:
+            unstable = set()
+            for slot in slots:
+                for use in slot.getOpUses():
+                    if not isa(use, lua.copy) or lua.copy(use).tgt() != slot:
+                        continue
+                    if not isStableSource(lua.copy(use).val(), slots):
+                        unstable.add(slot)
+            slots -= unstable
+            # A slot read before its definition has no value to start from.
+            self.computeLiveness(slots)
+            undefined = self.liveIn[self.blocks[0]] & slots
+            slots -= undefined
+            changed = bool(unstable or undefined)
+        self.order = [slot for slot in self.order if slot in slots]
+        self.slots = slots
+        return bool(slots)
+
+    def computeLiveness(self, slots):
+        upward = {}
+        defs = {}
+        for block in self.blocks:
+            upward[block] = set()
+            defs[block] = set()
+            for op in block:
+                for _, val in slotReads(op, slots):
+                    if val not in defs[block]:
+                        upward[block].add(val)
+                defs[block].update(slotWrites(op, slots))
+        self.liveIn = {block: set(upward[block]) for block in self.blocks}
+        changed = True
+        while changed:
+            changed = False
+            for block in reversed(self.blocks):
+                liveOut = set()
+                for succ in self.succs[block]:
+                    liveOut |= self.liveIn[succ]
+                liveIn = upward[block] | (liveOut - defs[block])
+                if liveIn != self.liveIn[block]:
+                    self.liveIn[block] = liveIn
+                    changed = True
+
+    def rename(self):
+        # Walk each block with the value of each slot at that point, starting
+        # from a placeholder argument for every slot live into the block.
+        self.phis = {}
+        self.reads = []
+        self.copies = []
+        defsOut = {}
+        for block in self.blocks:
+            self.phis[block] = {slot: BlockArgPhi(slot) for slot in self.order
+                                if slot in self.liveIn[block]}
+            cur = dict(self.phis[block])
+            for op in block:
+                for idx, val in slotReads(op, self.slots):
+                    self.reads.append((op, idx, cur[val]))
+                if isa(op, lua.copy) and lua.copy(op).tgt() in self.slots:
+                    val = lua.copy(op).val()
+                    cur[lua.copy(op).tgt()] = (cur[val] if val in self.slots
+                                               else val)
+                    self.copies.append(op)
+                else:
+                    for res in slotWrites(op, self.slots):
+                        cur[res] = res
+            defsOut[block] = cur
+        for block in self.blocks:
+            for succ in self.succs[block]:
+                for slot, phi in self.phis[succ].items():
+                    phi.incoming.append(defsOut[block][slot])
+        self.defsOut = defsOut
+
+    def removeTrivialPhis(self):
+        phis = [phi for block in self.blocks
+                for phi in self.phis[block].values()]
+        changed = True
+        while changed:
+            changed = False
+            for phi in phis:
+                if phi.same != None:
+                    continue
+                vals = set(resolvePhi(val) for val in phi.incoming)
+                vals.discard(phi)
+                if len(vals) == 1:
+                    phi.same = vals.pop()
+                    changed = True
+
+    def materialize(self, rewriter:Builder):
+        def resolve(val):
+            val = resolvePhi(val)
+            return val.arg if isinstance(val, BlockArgPhi) else val
+
+        numArgs = {}
+        args = {}
+        for block in self.blocks:
+            numArgs[block] = block.getNumArguments()
+            args[block] = []
+            for slot in self.order:
+                phi = self.phis[block].get(slot)
+                if phi == None or phi.same != None:
+                    continue
+                block.addArg(lua.val())
+                phi.arg = block.getArgument(block.getNumArguments() - 1)
+                args[block].append(phi)
+
+        for op, idx, val in self.reads:
+            op.setOperand(idx, resolve(val))
+
+        for block in self.blocks:
+            if not any(args[succ] for succ in self.succs[block]):
+                continue
+            term = block.getTerminator()
+            outs = self.defsOut[block]
+            extra = [[resolve(outs[phi.var]) for phi in args[succ]]
+                     for succ in self.succs[block]]
+            rewriter.insertBefore(term)
+            if term.name == "std.br":
+                rewriter.create(BranchOp, dest=self.succs[block][0],
+                                destOperands=term.getOperands() + extra[0],
+                                loc=term.loc)
+            else:
+                operands = term.getOperands()
+                trueDest, falseDest = self.succs[block]
+                nTrue = numArgs[trueDest]
+                rewriter.create(
+                    CondBranchOp, cond=operands[0], trueDest=trueDest,
+                    falseDest=falseDest,
+                    trueOperands=operands[1:1 + nTrue] + extra[0],
+                    falseOperands=operands[1 + nTrue:] + extra[1],
+                    loc=term.loc)
+            rewriter.erase(term)
+
+        for copy in self.copies:
+            rewriter.erase(copy)
+        for slot in self.order:
+            if isa(slot.definingOp, lua.alloc) and slot.useEmpty():
+                rewriter.erase(slot.definingOp)
+
+def promoteLocals(module:ModuleOp):
+    rewriter = Builder()
+    for func in module.getOps(FuncOp):
+        if len(func.getRegion(0)) == 0:
+            continue
+        promoter = SlotPromoter(func)
+        if not promoter.selectSlots():
+            continue
+        promoter.rename()
+        promoter.removeTrivialPhis()
+        promoter.materialize(rewriter)
+
 ################################################################################
 # IR: Optimizations
 ################################################################################
@@ -1050,10 +1383,60 @@ def tableSetPrealloc(op:lua.table_set, rewriter:Builder):
     rewriter.erase(op)
     return True
 
+def constStringKey(op):
+    return (isa(op.key().definingOp, lua.get_string) and
+            neverWrittenTo(op.key()))
+
+def tableGetCached(op:lua.table_get, rewriter:Builder):
+    if not constStringKey(op):
+        return False
+    val = rewriter.create(luaopt.table_get_cached, tbl=op.tbl(), key=op.key(),
+                          loc=op.loc).val()
+    rewriter.replace(op, [val])
+    return True
+
+def tableSetCached(op:lua.table_set, rewriter:Builder):
+    if not constStringKey(op):
+        return False
+    rewriter.create(luaopt.table_set_cached, tbl=op.tbl(), key=op.key(),
+                    val=op.val(), loc=op.loc)
+    rewriter.erase(op)
+    return True
+
+def isCallee(fcn, use):
+    return isa(use, lua.call) and lua.call(use).fcn() == fcn
+
+def callKnownClosure(op, rewriter):
+    # A closure value that is never reassigned or captured always refers to
+    # this function, so calls through it can call the function directly with
+    # the capture pack. If it is only ever called, the closure object does not
+    # escape and is not created at all.
+    fcn = op.fcn()
+    uses = fcn.getOpUses()
+    if (not neverWrittenTo(fcn) or
+            any(isa(use, lua.make_capture) for use in uses)):
+        return False
+    calls = [lua.call(use) for use in uses if isCallee(fcn, use)]
+    escapes = len(calls) != len(uses)
+    if not calls and escapes:
+        return False
+    for call in calls:
+        rewriter.insertBefore(call)
+        icall = rewriter.create(CallIndirectOp, callee=op.addr(),
+                                operands=[op.capture(), call.args()],
+                                loc=call.loc)
+        rewriter.replace(call, icall.results())
+    if not escapes:
+        rewriter.erase(op)
+    return True
+
 def applyOpts(module):
+    applyOptPatterns(module, [Pattern(luac.make_fcn, callKnownClosure)])
     applyOptPatterns(module, [
         Pattern(lua.table_get, tableGetPrealloc),
         Pattern(lua.table_set, tableSetPrealloc),
+        Pattern(lua.table_get, tableGetCached),
+        Pattern(lua.table_set, tableSetCached),
     ])
     #applyCSE(module, licmCanHoist)
 
@@ -1179,7 +1562,12 @@ def lowerGetString(module:ModuleOp):
 def expandMakeCapture(op, rewriter):
     sz = rewriter.create(ConstantOp, value=I32Attr(len(op.vals())),
                          loc=op.loc).result()
-    cap = rewriter.create(luac.new_capture, size=sz, loc=op.loc).capture()
+    # Capture packs only passed to direct calls (see `callKnownClosure`) do not
+    # outlive the calls, so they can live in the caller's frame.
+    onStack = all(isa(use, CallIndirectOp)
+                  for use in op.capture().getOpUses())
+    newCapture = luac.alloca_capture if onStack else luac.new_capture
+    cap = rewriter.create(newCapture, size=sz, loc=op.loc).capture()
     for i in range(0, len(op.vals())):
         idx = rewriter.create(ConstantOp, value=I32Attr(i), loc=op.loc).result()
         rewriter.create(luac.add_capture, capture=cap, val=op.vals()[i],
@@ -1263,6 +1651,254 @@ def lowerToLuac(module:ModuleOp):
     applyFullConversion(module, patterns, target)
     applyOptPatterns(module, [Pattern(luac.convert_bool_like, knownBool)])
 
+################################################################################
+# IR: Number Type Inference and Unboxing
+################################################################################
+
+# Lua values are mutable slots, so a value has a known number type only if its
+# definition and every write into it produce that type. The analysis is
+# optimistic: arithmetic results start out undetermined and are demoted until a
+# fixed point is reached, which lets loop-carried values such as numeric-for
+# induction variables and accumulators be proven numeric.
+#
+# Arithmetic and comparisons on proven numbers are then expanded to raw
+# i64/f64 operations in place of calls into lib.mlir, and wrap/unwrap pairs are
+# folded. The slots that remain are plain allocas, so values are only boxed
+# where they escape: into a pack, a table or a capture.
+#
+# Block arguments left by promoteLocals take the meet of the values branched
+# into them, and those proven numeric are rewritten to carry the raw number.
+
+NUM_INT = "int"
+NUM_REAL = "real"
+NUM_ANY = "any"
+
+def meetNumberType(lhs, rhs):
+    if lhs == None:
+        return rhs
+    if rhs == None or lhs == rhs:
+        return lhs
+    return NUM_ANY
+
+numberArithOps = {
+    luac.add: (AddIOp, AddFOp),
+    luac.sub: (SubIOp, SubFOp),
+    luac.mul: (MulIOp, MulFOp),
+}
+
+numberCompareOps = {
+    luac.lt: (CmpIPredicate.slt, CmpFPredicate.olt),
+    luac.le: (CmpIPredicate.sle, CmpFPredicate.ole),
+    luac.gt: (CmpIPredicate.sgt, CmpFPredicate.ogt),
+    luac.ge: (CmpIPredicate.sge, CmpFPredicate.oge),
+    luac.eq: (CmpIPredicate.eq, CmpFPredicate.oeq),
+    luac.ne: (CmpIPredicate.ne, CmpFPredicate.une),
+}
+
+def isNumberArith(op):
+    return (any(isa(op, opCls) for opCls in numberArithOps) or
+            isa(op, luac.neg))
+
+class NumberTypes:
+    def __init__(self, module):
+        # None marks a value whose type is not yet determined.
+        self.types = {}
+        self.writes = {}
+        self.incoming = {}
+        for op in module:
+            walkInOrder(op, self.addDefs)
+        for val in list(self.types):
+            self.addWrites(val)
+        self.solve()
+
+    def get(self, val):
+        ty = self.types.get(val, NUM_ANY)
+        return NUM_ANY if ty == None else ty
+
+    def set(self, val, ty):
+        self.types[val] = ty
+
+    def addDefs(self, op):
+        if isa(op, luac.wrap_int):
+            ty = NUM_INT
+        elif isa(op, luac.wrap_real):
+            ty = NUM_REAL
+        elif isNumberArith(op):
+            ty = None
+        else:
+            ty = NUM_ANY
+        for res in op.getResults():
+            if res.type == lua.val():
+                self.types[res] = ty
+        for succ, operands in successorOperands(op):
+            for i, operand in enumerate(operands):
+                arg = succ.getArgument(i)
+                if arg.type == lua.val():
+                    self.types[arg] = None
+                    self.incoming.setdefault(arg, []).append(operand)
+
+    def addWrites(self, val):
+        self.writes[val] = list(self.incoming.get(val, []))
+        for use in val.getOpUses():
+            if isa(use, lua.copy) and lua.copy(use).tgt() == val:
+                self.writes[val].append(lua.copy(use).val())
+            elif (val in getWriteEffectingValues(use) or
+                    isa(use, luac.add_capture)):
+                # Captured values may be written by the closure.
+                self.types[val] = NUM_ANY
+
+    def solve(self):
+        changed = True
+        while changed:
+            changed = False
+            for val, ty in self.types.items():
+                if ty == NUM_ANY:
+                    continue
+                newTy = ty
+                if val.definingOp and isNumberArith(val.definingOp):
+                    for operand in val.definingOp.getOperands():
+                        newTy = meetNumberType(newTy,
+                                               self.types.get(operand, NUM_ANY))
+                for src in self.writes[val]:
+                    newTy = meetNumberType(newTy, self.types.get(src, NUM_ANY))
+                if newTy != ty:
+                    self.types[val] = newTy
+                    changed = True
+
+def unboxNumber(b, val, ty, loc):
+    if ty == NUM_INT:
+        return b.create(luac.get_int_val, val=val, loc=loc).num()
+    return b.create(luac.get_double_val, val=val, loc=loc).num()
+
+def boxNumber(b, num, ty, loc):
+    if ty == NUM_INT:
+        return b.create(luac.wrap_int, num=num, loc=loc).res()
+    return b.create(luac.wrap_real, num=num, loc=loc).res()
+
+def knownNumberOperands(types, op):
+    tys = set(types.get(operand) for operand in op.getOperands())
+    if len(tys) != 1:
+        return None
+    ty = tys.pop()
+    return ty if ty in (NUM_INT, NUM_REAL) else None
+
+def unboxArith(types, opCls):
+    def convert(op, b):
+        ty = knownNumberOperands(types, op)
+        if not ty:
+            return False
+        intCls, realCls = numberArithOps[opCls]
+        lhs = unboxNumber(b, op.lhs(), ty, op.loc)
+        rhs = unboxNumber(b, op.rhs(), ty, op.loc)
+        if ty == NUM_INT:
+            num = b.create(intCls, lhs=lhs, rhs=rhs, ty=I64Type(),
+                           loc=op.loc).result()
+        else:
+            num = b.create(realCls, lhs=lhs, rhs=rhs, ty=F64Type(),
+                           loc=op.loc).result()
+        res = boxNumber(b, num, ty, op.loc)
+        types.set(res, types.get(op.res()))
+        b.replace(op, [res])
+        return True
+    return convert
+
+def unboxNeg(types):
+    def convert(op, b):
+        ty = knownNumberOperands(types, op)
+        if not ty:
+            return False
+        num = unboxNumber(b, op.val(), ty, op.loc)
+        if ty == NUM_INT:
+            zero = b.create(ConstantOp, value=I64Attr(0), loc=op.loc).result()
+            num = b.create(SubIOp, lhs=zero, rhs=num, ty=I64Type(),
+                           loc=op.loc).result()
+        else:
+            # Multiplying by -1.0 negates exactly, including signed zeros.
+            negOne = b.create(ConstantOp, value=F64Attr(-1.0),
+                              loc=op.loc).result()
+            num = b.create(MulFOp, lhs=negOne, rhs=num, ty=F64Type(),
+                           loc=op.loc).result()
+        res = boxNumber(b, num, ty, op.loc)
+        types.set(res, types.get(op.res()))
+        b.replace(op, [res])
+        return True
+    return convert
+
+def unboxCompare(types, opCls):
+    def convert(op, b):
+        ty = knownNumberOperands(types, op)
+        if not ty:
+            return False
+        intPred, realPred = numberCompareOps[opCls]
+        lhs = unboxNumber(b, op.lhs(), ty, op.loc)
+        rhs = unboxNumber(b, op.rhs(), ty, op.loc)
+        if ty == NUM_INT:
+            cmp = b.create(CmpIOp, res=luac.bool(), pred=intPred, lhs=lhs,
+                           rhs=rhs, loc=op.loc).result()
+        else:
+            cmp = b.create(CmpFOp, res=luac.bool(), pred=realPred, lhs=lhs,
+                           rhs=rhs, loc=op.loc).result()
+        res = b.create(luac.wrap_bool, b=cmp, loc=op.loc).res()
+        b.replace(op, [res])
+        return True
+    return convert
+
+def foldUnwrap(wrapCls, getOperand):
+    def convert(op, b):
+        if not isa(op.val().definingOp, wrapCls) or not neverWrittenTo(op.val()):
+            return False
+        b.replace(op, [getOperand(wrapCls(op.val().definingOp))])
+        return True
+    return convert
+
+def unboxBlockArgs(types, module):
+    argTypes = {}
+    for arg in types.incoming:
+        ty = types.get(arg)
+        if ty in (NUM_INT, NUM_REAL):
+            argTypes[arg] = ty
+    if not argTypes:
+        return
+    b = Builder()
+
+    def unboxIncoming(term):
+        for succ, indices in successorOperandIndices(term):
+            for argIdx, opIdx in enumerate(indices):
+                ty = argTypes.get(succ.getArgument(argIdx))
+                if not ty:
+                    continue
+                b.insertBefore(term)
+                num = unboxNumber(b, term.getOperand(opIdx), ty, term.loc)
+                term.setOperand(opIdx, num)
+    for op in module:
+        walkInOrder(op, unboxIncoming)
+
+    # Box the number again for the remaining users, which fold the unwraps.
+    for arg, ty in argTypes.items():
+        uses = list(arg.getUses())
+        b.insertAtStart(arg.owner)
+        box = boxNumber(b, arg, ty, arg.loc)
+        types.set(box, ty)
+        for use in uses:
+            use.set(box)
+        arg.type = I64Type() if ty == NUM_INT else F64Type()
+
+def unboxNumbers(module):
+    types = NumberTypes(module)
+    unboxBlockArgs(types, module)
+    patterns = [
+        Pattern(luac.neg, unboxNeg(types)),
+        Pattern(luac.get_int_val, foldUnwrap(luac.wrap_int, lambda w: w.num())),
+        Pattern(luac.get_double_val,
+                foldUnwrap(luac.wrap_real, lambda w: w.num())),
+        Pattern(luac.get_bool_val, foldUnwrap(luac.wrap_bool, lambda w: w.b())),
+    ]
+    for opCls in numberArithOps:
+        patterns.append(Pattern(opCls, unboxArith(types, opCls)))
+    for opCls in numberCompareOps:
+        patterns.append(Pattern(opCls, unboxCompare(types, opCls)))
+    applyOptPatterns(module, patterns)
+
 ################################################################################
 # IR: Lua to LLVMIR Pass 1
 ################################################################################
@@ -1293,6 +1929,8 @@ def packTyAndU(b, ty, u, loc):
                     value=u, pos=I64ArrayAttr([1]), loc=loc).res()
 
 def loadRef(b, ref, loc):
+    if NAN_BOXING:
+        return loadNanBoxedRef(b, ref, loc)
     return packTyAndU(b, *unpackTyAndU(b, ref, loc), loc)
 
 def convertLuaNil(op, b):
@@ -1309,14 +1947,29 @@ def convertLuaTable(op, b):
     b.replace(op, [ref])
     return True
 
-def convertLuacLoadString(op, b):
-    ref = allocaTyped(b, luac.type_str(), op.loc)
-    strData = b.create(luallvm.get_string_data, sym=op.global_sym(), loc=op.loc)
-    impl = b.create(luallvm.load_string_impl, data=strData.data(),
-                    length=strData.length(), loc=op.loc).impl()
-    b.create(luallvm.set_impl_direct, ref=ref, impl=impl, loc=op.loc)
-    b.replace(op, [ref])
-    return True
+# String literals are interned once in `main`, before `lua_main` runs, and
+# each use loads the interned string from a global.
+string_impls = []
+
+def convertLuacLoadString(module):
+    def convert(op, b):
+        name = op.global_sym().getValue() + "_impl"
+        symbol = module.lookup(name)
+        if symbol:
+            glob = LLVMGlobalOp(symbol)
+        else:
+            glob = LLVMGlobalOp(luallvm.impl(), False, LLVMLinkage.Internal(),
+                                name, Attribute(), UnknownLoc())
+            module.append(glob)
+            string_impls.append((op.global_sym(), glob))
+        ref = allocaTyped(b, luac.type_str(), op.loc)
+        ptr = b.create(LLVMAddressOfOp, value=glob, loc=op.loc).res()
+        impl = b.create(LLVMLoadOp, res=luallvm.impl(), addr=ptr,
+                        loc=op.loc).res()
+        b.create(luallvm.set_impl_direct, ref=ref, impl=impl, loc=op.loc)
+        b.replace(op, [ref])
+        return True
+    return convert
 
 def convertLuacWrapBool(op, b):
     ref = allocaTyped(b, luac.type_bool(), op.loc)
@@ -1351,44 +2004,18 @@ def convertLuaCopy(op, b):
     return True
 
 def convertLuaTableGet(op, b):
-    keyU = b.create(luallvm.get_u_direct, ref=op.key(), loc=op.loc).u()
-    negOne = llvmI64Const(b, -1, op.loc)
-    iv = b.create(AddIOp, ty=I64Type(), lhs=keyU, rhs=negOne, loc=op.loc).result()
-
     impl = b.create(luallvm.get_impl_direct, ref=op.tbl(), loc=op.loc).impl()
-    arrPtr = b.create(LLVMBitcastOp, res=luallvm.ref(), arg=impl,
-                      loc=op.loc).res()
-    elPtr = b.create(LLVMGEPOp, res=luallvm.ref(), base=arrPtr,
-                     indices=[iv], loc=op.loc).res()
-    val = loadRef(b, elPtr, op.loc)
-
-    #impl = b.create(luallvm.get_impl_direct, ref=op.tbl(), loc=op.loc).impl()
-    #key = loadRef(b, op.key(), op.loc)
-    #val = b.create(luallvm.table_get_impl, impl=impl, key=key, loc=op.loc).val()
-
+    key = loadRef(b, op.key(), op.loc)
+    val = b.create(luallvm.table_get_impl, impl=impl, key=key, loc=op.loc).val()
     valPtr = b.create(luac.into_alloca, val=val, loc=op.loc).res()
     b.replace(op, [valPtr])
     return True
 
 def convertLuaTableSet(op, b):
-    keyU = b.create(luallvm.get_u_direct, ref=op.key(), loc=op.loc).u()
-    negOne = llvmI64Const(b, -1, op.loc)
-    iv = b.create(AddIOp, ty=I64Type(), lhs=keyU, rhs=negOne, loc=op.loc).result()
-
     impl = b.create(luallvm.get_impl_direct, ref=op.tbl(), loc=op.loc).impl()
-    arrPtr = b.create(LLVMBitcastOp, res=luallvm.ref(), arg=impl,
-                      loc=op.loc).res()
-    elPtr = b.create(LLVMGEPOp, res=luallvm.ref(), base=arrPtr,
-                     indices=[iv], loc=op.loc).res()
-    ty, u = unpackTyAndU(b, op.val(), op.loc)
-    b.create(luallvm.set_type_direct, ref=elPtr, type=ty, loc=op.loc)
-    b.create(luallvm.set_u_direct, ref=elPtr, u=u, loc=op.loc)
-
-    #impl = b.create(luallvm.get_impl_direct, ref=op.tbl(), loc=op.loc).impl()
-    #key = loadRef(b, op.key(), op.loc)
-    #val = loadRef(b, op.val(), op.loc)
-    #b.create(luallvm.table_set_impl, impl=impl, key=key, val=val, loc=op.loc)
-
+    key = loadRef(b, op.key(), op.loc)
+    val = loadRef(b, op.val(), op.loc)
+    b.create(luallvm.table_set_impl, impl=impl, key=key, val=val, loc=op.loc)
     b.erase(op)
     return True
 
@@ -1425,6 +2052,42 @@ def convertLuaoptTableSetPrealloc(op, b):
     b.erase(op)
     return True
 
+# Each cached table access site gets its own cache slot, holding the hash part
+# index where its key was last found, or -1.
+inline_caches = []
+
+def getInlineCache(module, b, loc):
+    cache = LLVMGlobalOp(LLVMType.Int64(), False, LLVMLinkage.Internal(),
+                         "lua_ic_" + str(len(inline_caches)), I64Attr(-1),
+                         UnknownLoc())
+    module.append(cache)
+    inline_caches.append(cache)
+    return b.create(LLVMAddressOfOp, value=cache, loc=loc).res()
+
+def convertLuaoptTableGetCached(module):
+    def convert(op, b):
+        impl = b.create(luallvm.get_impl_direct, ref=op.tbl(), loc=op.loc).impl()
+        key = loadRef(b, op.key(), op.loc)
+        cache = getInlineCache(module, b, op.loc)
+        val = b.create(luallvm.table_get_cached_impl, impl=impl, key=key,
+                       cache=cache, loc=op.loc).val()
+        valPtr = b.create(luac.into_alloca, val=val, loc=op.loc).res()
+        b.replace(op, [valPtr])
+        return True
+    return convert
+
+def convertLuaoptTableSetCached(module):
+    def convert(op, b):
+        impl = b.create(luallvm.get_impl_direct, ref=op.tbl(), loc=op.loc).impl()
+        key = loadRef(b, op.key(), op.loc)
+        val = loadRef(b, op.val(), op.loc)
+        cache = getInlineCache(module, b, op.loc)
+        b.create(luallvm.table_set_cached_impl, impl=impl, key=key, val=val,
+                 cache=cache, loc=op.loc)
+        b.erase(op)
+        return True
+    return convert
+
 def convertLuacMakeFcn(op, b):
     ref = allocaTyped(b, luac.type_fcn(), op.loc)
     impl = b.create(luallvm.make_fcn_impl, addr=op.addr(), capture=op.capture(),
@@ -1470,20 +2133,25 @@ def convertLuaBuiltin(op, b):
     b.replace(op, [ref])
     return True
 
-malloc = None
-realloc = None
+def convertLuacNewCapture(module):
+    def convert(op, b):
+        # Capture packs are owned by the runtime collector.
+        newCapture = module.lookup("lua_new_capture")
+        assert newCapture, "cannot find lib.mlir function 'lua_new_capture'"
+        capture = b.create(CallOp, callee=newCapture, operands=[op.size()],
+                           loc=op.loc).getResult(0)
+        b.replace(op, [capture])
+        return True
+    return convert
 
-def convertLuacNewCapture(op, b):
-    # Assumes 64-bit pointers, sizeof(TObject *) == 8
-    ptrSz = b.create(ConstantOp, value=I32Attr(8), loc=op.loc).result()
-    memSz = b.create(MulIOp, ty=I32Type(), lhs=ptrSz, rhs=op.size(),
-                     loc=op.loc).result()
-    memSzI64 = b.create(IndexCastOp, source=memSz, type=IndexType(),
-                        loc=op.loc).result()
-    ptr = b.create(CallOp, callee=malloc, operands=[memSzI64],
-                   loc=op.loc).getResult(0)
-    capture = b.create(LLVMBitcastOp, res=luallvm.capture(), arg=ptr,
-                       loc=op.loc).res()
+def convertLuacAllocaCapture(op, b):
+    # Like fixed-size argument packs, stack capture packs are allocated once
+    # per frame.
+    size = ConstantOp(op.size().definingOp).value().getInt()
+    b.insertAtStart(op.parentRegion.getBlock(0))
+    arrSz = llvmI32Const(b, max(size, 1), op.loc)
+    capture = b.create(LLVMAllocaOp, res=luallvm.capture(), arrSz=arrSz,
+                       align=I64Attr(8), loc=op.loc).res()
     b.replace(op, [capture])
     return True
 
@@ -1502,16 +2170,10 @@ def convertLuacGetCapture(op, b):
     return True
 
 def luaToLLVMFirstPass(module):
-    global malloc, realloc
-    malloc = FuncOp("malloc", FunctionType([IndexType()], [LLVMType.Int8Ptr()]))
-    realloc = FuncOp("realloc", FunctionType([LLVMType.Int8Ptr(), IndexType()],
-                                             [LLVMType.Int8Ptr()]))
-    module.append(malloc)
-    module.append(realloc)
     applyOptPatterns(module, [
         Pattern(lua.nil, convertLuaNil),
         Pattern(lua.table, convertLuaTable),
-        Pattern(luac.load_string, convertLuacLoadString),
+        Pattern(luac.load_string, convertLuacLoadString(module)),
         Pattern(luac.wrap_bool, convertLuacWrapBool),
         Pattern(luac.wrap_int, convertLuacWrapInt),
         Pattern(luac.wrap_real, convertLuacWrapReal),
@@ -1520,6 +2182,8 @@ def luaToLLVMFirstPass(module):
         Pattern(lua.table_set, convertLuaTableSet),
         Pattern(luaopt.table_get_prealloc, convertLuaoptTableGetPrealloc),
         Pattern(luaopt.table_set_prealloc, convertLuaoptTableSetPrealloc),
+        Pattern(luaopt.table_get_cached, convertLuaoptTableGetCached(module)),
+        Pattern(luaopt.table_set_cached, convertLuaoptTableSetCached(module)),
         Pattern(luac.make_fcn, convertLuacMakeFcn),
         Pattern(luac.get_impl, convertLuacGetImpl),
         Pattern(luac.get_type, convertLuacGetType),
@@ -1527,10 +2191,21 @@ def luaToLLVMFirstPass(module):
         Pattern(luac.get_int_val, convertLuacGetIntVal),
         Pattern(luac.get_double_val, convertLuacGetDoubleVal),
         Pattern(lua.builtin, convertLuaBuiltin),
-        Pattern(luac.new_capture, convertLuacNewCapture),
+        Pattern(luac.new_capture, convertLuacNewCapture(module)),
+        Pattern(luac.alloca_capture, convertLuacAllocaCapture),
         Pattern(luac.add_capture, convertLuacAddCapture),
         Pattern(luac.get_capture, convertLuacGetCapture),
     ])
+    retypeBlockArgs(module)
+
+def retypeBlockArgs(module):
+    # Values are now refs to their slots, including those that promoteLocals
+    # passes between blocks.
+    for func in module.getOps(FuncOp):
+        for block in list(func.getRegion(0))[1:]:
+            for arg in block.args:
+                if arg.type == lua.val():
+                    arg.type = luallvm.ref()
 
 ################################################################################
 # IR: Lua to LLVMIR Pass 2
@@ -1768,6 +2443,34 @@ def convertLuacGetPack(packPtr):
         b.replace(op, [v1])
     return convert
 
+def convertLuacGetArgPack(argPackPtr):
+    getShared = convertLuacGetPack(argPackPtr)
+    def convert(op, b):
+        # Argument packs of a known size are given their own slots in the
+        # caller's frame. The callee unpacks its arguments on entry and packs
+        # never outlive the call, so the slots can be reused by every
+        # execution of the call site. Packs with a variadic tail still use
+        # the shared buffer.
+        if not isa(op.size().definingOp, ConstantOp):
+            return getShared(op, b)
+        size = ConstantOp(op.size().definingOp).value().getInt()
+        b.insertAtStart(op.parentRegion.getBlock(0))
+        arrSz = llvmI32Const(b, max(size, 1), op.loc)
+        objs = b.create(LLVMAllocaOp, res=luallvm.ref(), arrSz=arrSz,
+                        align=I64Attr(8), loc=op.loc).res()
+        b.insertBefore(op)
+        undef = b.create(LLVMUndefOp, ty=luallvm.pack(), loc=op.loc).res()
+        v0 = b.create(LLVMInsertValueOp, res=luallvm.pack(), container=undef,
+                      value=op.size(), pos=I64ArrayAttr([0]), loc=op.loc).res()
+        v1 = b.create(LLVMInsertValueOp, res=luallvm.pack(), container=v0,
+                      value=objs, pos=I64ArrayAttr([1]), loc=op.loc).res()
+        b.replace(op, [v1])
+        return True
+    return convert
+
+# sizeof(TObject) in the runtime.
+VALUE_SIZE = 8 if NAN_BOXING else 16
+
 def prepMain(module, argPackPtr, retPackPtr):
     b = Builder()
     main = FuncOp("main", FunctionType([], [I32Type()]))
@@ -1785,8 +2488,18 @@ def prepMain(module, argPackPtr, retPackPtr):
                           loc=main.loc).res()
         tgt = b.create(LLVMAddressOfOp, value=packPtr, loc=main.loc).res()
         b.create(LLVMStoreOp, value=memPtr, addr=tgt, loc=main.loc)
+        # Values in flight between calls live in the pack buffers.
+        memSz = llvmI64Const(b, 16 * VALUE_SIZE, main.loc)
+        b.create(CallOp, callee=module.lookup("lua_gc_add_root"),
+                 operands=[memPtr, memSz], loc=main.loc)
     giveMem("g_arg_pack_mem", argPackPtr)
     giveMem("g_ret_pack_mem", retPackPtr)
+    for sym, glob in string_impls:
+        strData = b.create(luallvm.get_string_data, sym=sym, loc=main.loc)
+        impl = b.create(luallvm.load_string_impl, data=strData.data(),
+                        length=strData.length(), loc=main.loc).impl()
+        ptr = b.create(LLVMAddressOfOp, value=glob, loc=main.loc).res()
+        b.create(LLVMStoreOp, value=impl, addr=ptr, loc=main.loc)
     luaMain = module.lookup("lua_main")
     b.create(CallOp, callee=luaMain, operands=[], loc=main.loc)
     ok = b.create(ConstantOp, value=I32Attr(0), loc=main.loc).result()
@@ -1807,7 +2520,7 @@ def luaToLLVMSecondPass(module):
         Pattern(luac.global_string, convertLuacGlobalString),
         Pattern(luallvm.get_string_data, convertLuaLLVMGetStringData(module)),
 
-        Pattern(luac.get_arg_pack, convertLuacGetPack(argPackPtr)),
+        Pattern(luac.get_arg_pack, convertLuacGetArgPack(argPackPtr)),
         Pattern(luac.get_ret_pack, convertLuacGetPack(retPackPtr)),
         Pattern(luac.pack_insert, convertLuacPackInsert),
         Pattern(luac.pack_get_unsafe, convertLuacPackGetUnsafe),
@@ -1819,16 +2532,105 @@ def luaToLLVMSecondPass(module):
     ])
     luaToLLVMLatePass(module)
 
+################################################################################
+# IR: NaN-boxed Value Access
+################################################################################
+
+# With --nan-boxing a value is a single i64 and the type and payload are no
+# longer separate fields. The *_direct accessors load the bits and defer to the
+# runtime's lua_value_* helpers, which are inlined at link time.
+
+def getBitsPtr(b, ref, loc):
+    zero = llvmI32Const(b, 0, loc)
+    return b.create(LLVMGEPOp, res=luallvm.u_ptr(), base=ref,
+                    indices=[zero, zero], loc=loc).res()
+
+def loadBits(b, ref, loc):
+    return b.create(LLVMLoadOp, res=luallvm.u(), addr=getBitsPtr(b, ref, loc),
+                    loc=loc).res()
+
+def storeBits(b, ref, bits, loc):
+    b.create(LLVMStoreOp, value=bits, addr=getBitsPtr(b, ref, loc), loc=loc)
+
+def callValueHelper(module, b, funcName, operands, loc):
+    func = module.lookup(funcName)
+    assert func, "cannot find lib.mlir function '" + funcName + "'"
+    return b.create(CallOp, callee=func, operands=operands,
+                    loc=loc).getResult(0)
+
+def convertNanBoxGetDirect(module, funcName):
+    def convert(op, b):
+        bits = loadBits(b, op.ref(), op.loc)
+        b.replace(op, [callValueHelper(module, b, funcName, [bits], op.loc)])
+        return True
+    return convert
+
+def convertNanBoxSetDirect(module, funcName, getOperand):
+    def convert(op, b):
+        bits = loadBits(b, op.ref(), op.loc)
+        bits = callValueHelper(module, b, funcName, [bits, getOperand(op)],
+                               op.loc)
+        storeBits(b, op.ref(), bits, op.loc)
+        b.erase(op)
+        return True
+    return convert
+
+def convertNanBoxSetTypeDirect(module):
+    def convert(op, b):
+        # Setting the type resets the payload, so the old bits are not needed.
+        bits = callValueHelper(module, b, "lua_value_set_type", [op.type()],
+                               op.loc)
+        storeBits(b, op.ref(), bits, op.loc)
+        b.erase(op)
+        return True
+    return convert
+
+def convertNanBoxIntoAlloca(op, b):
+    ref = b.create(luallvm.alloca_value, loc=op.loc).ref()
+    bits = b.create(LLVMExtractValueOp, res=luallvm.u(), container=op.val(),
+                    pos=I64ArrayAttr([0]), loc=op.loc).res()
+    storeBits(b, ref, bits, op.loc)
+    b.replace(op, [ref])
+    return True
+
+def loadNanBoxedRef(b, ref, loc):
+    bits = loadBits(b, ref, loc)
+    undef = b.create(LLVMUndefOp, ty=luallvm.value(), loc=loc).res()
+    return b.create(LLVMInsertValueOp, res=luallvm.value(), container=undef,
+                    value=bits, pos=I64ArrayAttr([0]), loc=loc).res()
+
+def valueAccessPatterns(module):
+    if not NAN_BOXING:
+        return [
+            Pattern(luallvm.get_type_direct, convertLuaLLVMGetTypeDirect),
+            Pattern(luallvm.set_type_direct, convertLuaLLVMSetTypeDirect),
+            Pattern(luallvm.get_u_direct, convertLuaLLVMGetUDirect),
+            Pattern(luallvm.set_u_direct, convertLuaLLVMSetUDirect),
+            Pattern(luallvm.get_impl_direct, convertLuaLLVMGetImplDirect),
+            Pattern(luallvm.set_impl_direct, convertLuaLLVMSetImplDirect),
+            Pattern(luac.into_alloca, convertLuacIntoAlloca),
+        ]
+    return [
+        Pattern(luallvm.get_type_direct,
+                convertNanBoxGetDirect(module, "lua_value_get_type")),
+        Pattern(luallvm.set_type_direct, convertNanBoxSetTypeDirect(module)),
+        Pattern(luallvm.get_u_direct,
+                convertNanBoxGetDirect(module, "lua_value_get_u")),
+        Pattern(luallvm.set_u_direct,
+                convertNanBoxSetDirect(module, "lua_value_set_u",
+                                       lambda op: op.u())),
+        Pattern(luallvm.get_impl_direct,
+                convertNanBoxGetDirect(module, "lua_value_get_impl")),
+        Pattern(luallvm.set_impl_direct,
+                convertNanBoxSetDirect(module, "lua_value_set_impl",
+                                       lambda op: op.impl())),
+        Pattern(luac.into_alloca, convertNanBoxIntoAlloca),
+    ]
+
 def luaToLLVMLatePass(module):
-    applyOptPatterns(module, [
+    applyOptPatterns(module, valueAccessPatterns(module) + [
         Pattern(luallvm.alloca_value, convertLuaLLVMAllocaValue),
         Pattern(luallvm.const_type, convertLuaLLVMConstType),
-        Pattern(luallvm.get_type_direct, convertLuaLLVMGetTypeDirect),
-        Pattern(luallvm.set_type_direct, convertLuaLLVMSetTypeDirect),
-        Pattern(luallvm.get_u_direct, convertLuaLLVMGetUDirect),
-        Pattern(luallvm.set_u_direct, convertLuaLLVMSetUDirect),
-        Pattern(luallvm.get_impl_direct, convertLuaLLVMGetImplDirect),
-        Pattern(luallvm.set_impl_direct, convertLuaLLVMSetImplDirect),
 
         Pattern(luallvm.get_type_ptr, convertLuaLLVMGetTypePtr),
         Pattern(luallvm.get_type, convertLuaLLVMGetType),
@@ -1840,7 +2642,6 @@ def luaToLLVMLatePass(module):
         Pattern(luallvm.get_impl, convertLuaLLVMGetImpl),
         Pattern(luallvm.set_impl, convertLuaLLVMSetImpl),
 
-        Pattern(luac.into_alloca, convertLuacIntoAlloca),
         Pattern(luac.load_from, convertLuacLoadFrom),
     ])
 
@@ -1911,6 +2712,8 @@ def luaToLLVMThirdPass(module):
         convert(luallvm.table_set_impl, "lua_table_set_impl"),
         convert(luallvm.table_get_prealloc_impl, "lua_table_get_prealloc_impl"),
         convert(luallvm.table_set_prealloc_impl, "lua_table_set_prealloc_impl"),
+        convert(luallvm.table_get_cached_impl, "lua_table_get_cached_impl"),
+        convert(luallvm.table_set_cached_impl, "lua_table_set_cached_impl"),
         convert(luallvm.make_fcn_impl, "lua_make_fcn_impl"),
         convert(luallvm.load_string_impl, "lua_load_string_impl"),
         convert(luallvm.new_table_impl, "lua_new_table_impl"),
@@ -1924,23 +2727,71 @@ def luaToLLVMThirdPass(module):
         lambda ty: luallvm.impl() if ty == luac.void_ptr() else None,
     ])
 
-def main():
-    if len(sys.argv) != 2:
-        print("Usage: luac.py <lua_file>")
-        return
-    filename = sys.argv[1]
-    with open(filename, 'r') as file:
-        contents = file.read()
-
+def antlrFrontend(filename, contents):
     lexer = LuaLexer(InputStream(contents))
     stream = CommonTokenStream(lexer)
     parser = LuaParser(stream)
-
     generator = Generator(filename, stream)
+    return generator.chunk(parser.chunk())
+
+def nativeFrontend(exe, filename):
+    # The C++ frontend emits the module Generator would, which is parsed back
+    # into this context for the remaining passes.
+    import subprocess
+    import tempfile
+    with tempfile.NamedTemporaryFile(suffix='.mlir') as out:
+        if subprocess.call([exe, cwd + "/lua.mlir", filename,
+                            "-o", out.name]) != 0:
+            sys.exit("native frontend failed on " + filename)
+        module = parseSourceFile(out.name)
+    assert module, "failed to load native frontend output"
+    return module, module.lookup("lua_main")
+
+def parseArgs():
+    import argparse
+    parser = argparse.ArgumentParser(
+        description="Compile a Lua file to the LLVM dialect.")
+    parser.add_argument("file", help="Lua source file")
+    parser.add_argument("--nan-boxing", action="store_true",
+                        help="use 8-byte NaN-boxed values")
+    parser.add_argument("--run", action="store_true",
+                        help="JIT the program in-process instead of printing "
+                             "the lowered module")
+    parser.add_argument("-O", dest="optLevel", type=int, default=2,
+                        choices=range(4), help="JIT optimization level")
+    parser.add_argument("--runtime", default=os.environ.get(
+                            "LUAC_RUNTIME", cwd + "/libluart.so"),
+                        help="runtime shared library to link with --run")
+    parser.add_argument("--time", action="store_true",
+                        help="report compile and run times to stderr")
+    parser.add_argument("--frontend", choices=["antlr", "native"],
+                        default="antlr",
+                        help="parse with the ANTLR parser or the C++ frontend")
+    parser.add_argument("--luac", default=os.environ.get(
+                            "LUAC_FRONTEND", cwd + "/luac"),
+                        help="C++ frontend executable for --frontend native")
+    parser.add_argument("--no-ssa", dest="ssa", action="store_false",
+                        help="keep locals in memory slots instead of "
+                             "promoting them to SSA values")
+    return parser.parse_args()
 
-    module, main = generator.chunk(parser.chunk())
+def main():
+    args = parseArgs()
+    with open(args.file, 'r') as file:
+        contents = file.read()
+
+    import time
+    start = time.perf_counter()
+
+    if args.frontend == "native":
+        module, main = nativeFrontend(args.luac, args.file)
+    else:
+        module, main = antlrFrontend(args.file, contents)
+    frontendTime = time.perf_counter() - start
     varAllocPass(module, main)
     cfExpand(module, main)
+    if args.ssa:
+        promoteLocals(module)
     applyOpts(module)
 
     lib = parseSourceFile(cwd + "/lib.mlir")
@@ -1948,12 +2799,26 @@ def main():
             module.append(func.clone())
 
     lowerToLuac(module)
+    unboxNumbers(module)
     lowerSCFToStandard(module)
     luaToLLVMFirstPass(module)
     luaToLLVMSecondPass(module)
     luaToLLVMThirdPass(module)
-    print(module)
-    verify(module)
+    lowerTime = time.perf_counter() - start
+    if not args.run:
+        print(module)
+        verify(module)
+        return
+    assert verify(module), "lowered module failed to verify"
+
+    # The runtime must be the one matching the value layout of the module.
+    exitCode, compileTime, runTime = jitRunMain(module, args.optLevel,
+                                                [args.runtime])
+    if args.time:
+        print("frontend: {:.3f}s, lower: {:.3f}s, jit: {:.3f}s, "
+              "run: {:.3f}s".format(frontendTime, lowerTime - frontendTime,
+                                    compileTime, runTime), file=sys.stderr)
+    sys.exit(exitCode)
 
 if __name__ == '__main__':
     main()
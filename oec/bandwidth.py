@@ -0,0 +1,68 @@
+import stencil
+import numpy as np
+import time
+
+# Memory bandwidth of a laplacian in single and double precision. The stencil
+# reads one field and writes another, so halving the element size should come
+# close to halving the time once the grid no longer fits in cache.
+
+@stencil.program
+def laplace_f64(a: np.float64, b: np.float64):
+  stencil.cast(a, [-4, -4, -4], [260, 260, 260])
+  stencil.cast(b, [-4, -4, -4], [260, 260, 260])
+  atmp = stencil.load(a)
+
+  def applyFcn(c) -> float:
+    return 4 * c[0, 0, 0] - c[-1, 0, 0] - c[1, 0, 0] - c[0, 1, 0] - c[0, -1, 0]
+
+  btmp = stencil.apply(atmp, applyFcn)
+  stencil.store(b, btmp, [0, 0, 0], [256, 256, 256])
+  return
+
+@stencil.program
+def laplace_f32(a: np.float32, b: np.float32):
+  stencil.cast(a, [-4, -4, -4], [260, 260, 260])
+  stencil.cast(b, [-4, -4, -4], [260, 260, 260])
+  atmp = stencil.load(a)
+
+  def applyFcn(c) -> float:
+    return 4 * c[0, 0, 0] - c[-1, 0, 0] - c[1, 0, 0] - c[0, 1, 0] - c[0, -1, 0]
+
+  btmp = stencil.apply(atmp, applyFcn)
+  stencil.store(b, btmp, [0, 0, 0], [256, 256, 256])
+  return
+
+# Stored as f32, computed in f64.
+@stencil.program(accumulate=np.float64)
+def laplace_f32_acc64(a: np.float32, b: np.float32):
+  stencil.cast(a, [-4, -4, -4], [260, 260, 260])
+  stencil.cast(b, [-4, -4, -4], [260, 260, 260])
+  atmp = stencil.load(a)
+
+  def applyFcn(c) -> float:
+    return 4 * c[0, 0, 0] - c[-1, 0, 0] - c[1, 0, 0] - c[0, 1, 0] - c[0, -1, 0]
+
+  btmp = stencil.apply(atmp, applyFcn)
+  stencil.store(b, btmp, [0, 0, 0], [256, 256, 256])
+  return
+
+data = np.random.rand(264, 264, 264)
+
+def measure(name, fcn, dtype, runs=20):
+  a = data.astype(dtype)
+  b = np.zeros([264, 264, 264], dtype=dtype)
+  fcn(a, b)
+  start = time.perf_counter()
+  for _ in range(runs):
+    fcn(a, b)
+  secs = (time.perf_counter() - start) / runs
+  # One read of the input and one write of the output per point.
+  moved = 2 * 256 ** 3 * np.dtype(dtype).itemsize
+  print("%-18s %8.3f ms %8.2f GB/s" % (name, 1e3 * secs, moved / secs / 1e9))
+  return b[4:260, 4:260, 4:260]
+
+ref = measure("f64", laplace_f64, np.float64)
+f32 = measure("f32", laplace_f32, np.float32)
+acc = measure("f32 (f64 acc)", laplace_f32_acc64, np.float32)
+print("max error f32: %.3g, f32 with f64 acc: %.3g" %
+      (np.abs(f32 - ref).max(), np.abs(acc - ref).max()))
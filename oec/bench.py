@@ -0,0 +1,239 @@
+import argparse
+import json
+import os
+import subprocess
+import sys
+import time
+
+# Stencil benchmark suite. Every kernel is run over a set of grid sizes and
+# thread counts and reported against a STREAM triad roofline measured at the
+# same thread count. Each thread count runs in its own process, since OpenMP
+# fixes the thread count at startup and kernels are compiled for it.
+#
+#   python bench.py --sizes 64,128,256 --threads 1,8 --format json -o out.json
+#
+# Traffic is the compulsory traffic of the kernel: every input field read once
+# and every output field written once. Temporaries are not counted, so a chain
+# that materializes them scores below the roofline by the extra traffic.
+
+HALO = 4
+
+# Each kernel: source template, flops per grid point, input and output
+# fields. Templates are formatted with the grid size `n` and halo bounds.
+KERNELS = {
+    "laplace": ("""
+def laplace(a, b):
+  stencil.cast(a, [{lb}, {lb}, {lb}], [{ub}, {ub}, {ub}])
+  stencil.cast(b, [{lb}, {lb}, {lb}], [{ub}, {ub}, {ub}])
+  atmp = stencil.load(a)
+
+  def applyFcn(c) -> float:
+    return 4 * c[0, 0, 0] - c[-1, 0, 0] - c[1, 0, 0] - c[0, 1, 0] - c[0, -1, 0]
+
+  btmp = stencil.apply(atmp, applyFcn)
+  stencil.store(b, btmp, [0, 0, 0], [{n}, {n}, {n}])
+  return
+""", 5, 1, 1),
+
+    # 5-point Jacobi in each plane of the grid.
+    "jacobi2d": ("""
+def jacobi2d(a, b):
+  stencil.cast(a, [{lb}, {lb}, {lb}], [{ub}, {ub}, {ub}])
+  stencil.cast(b, [{lb}, {lb}, {lb}], [{ub}, {ub}, {ub}])
+  atmp = stencil.load(a)
+
+  def applyFcn(c) -> float:
+    return 0.2 * (c[0, 0, 0] + c[-1, 0, 0] + c[1, 0, 0] + c[0, -1, 0] +
+                  c[0, 1, 0])
+
+  btmp = stencil.apply(atmp, applyFcn)
+  stencil.store(b, btmp, [0, 0, 0], [{n}, {n}, {n}])
+  return
+""", 5, 1, 1),
+
+    "jacobi3d": ("""
+def jacobi3d(a, b):
+  stencil.cast(a, [{lb}, {lb}, {lb}], [{ub}, {ub}, {ub}])
+  stencil.cast(b, [{lb}, {lb}, {lb}], [{ub}, {ub}, {ub}])
+  atmp = stencil.load(a)
+
+  def applyFcn(c) -> float:
+    return 0.142857 * (c[0, 0, 0] + c[-1, 0, 0] + c[1, 0, 0] + c[0, -1, 0] +
+                       c[0, 1, 0] + c[0, 0, -1] + c[0, 0, 1])
+
+  btmp = stencil.apply(atmp, applyFcn)
+  stencil.store(b, btmp, [0, 0, 0], [{n}, {n}, {n}])
+  return
+""", 7, 1, 1),
+
+    # Radius 2 star: the center and six points at each distance.
+    "star13": ("""
+def star13(a, b):
+  stencil.cast(a, [{lb}, {lb}, {lb}], [{ub}, {ub}, {ub}])
+  stencil.cast(b, [{lb}, {lb}, {lb}], [{ub}, {ub}, {ub}])
+  atmp = stencil.load(a)
+
+  def applyFcn(c) -> float:
+    return (0.5 * c[0, 0, 0] +
+            0.0625 * (c[-1, 0, 0] + c[1, 0, 0] + c[0, -1, 0] + c[0, 1, 0] +
+                      c[0, 0, -1] + c[0, 0, 1]) +
+            0.02 * (c[-2, 0, 0] + c[2, 0, 0] + c[0, -2, 0] + c[0, 2, 0] +
+                    c[0, 0, -2] + c[0, 0, 2]))
+
+  btmp = stencil.apply(atmp, applyFcn)
+  stencil.store(b, btmp, [0, 0, 0], [{n}, {n}, {n}])
+  return
+""", 15, 1, 1),
+
+    # Horizontal diffusion without the flux limiter: a laplacian, the fluxes
+    # across the faces in i and j, and the update from their divergence.
+    "hdiff": ("""
+def hdiff(a, b):
+  stencil.cast(a, [{lb}, {lb}, {lb}], [{ub}, {ub}, {ub}])
+  stencil.cast(b, [{lb}, {lb}, {lb}], [{ub}, {ub}, {ub}])
+  atmp = stencil.load(a)
+
+  def lapFcn(c) -> float:
+    return 4 * c[0, 0, 0] - c[-1, 0, 0] - c[1, 0, 0] - c[0, 1, 0] - c[0, -1, 0]
+
+  def flxFcn(l) -> float:
+    return l[1, 0, 0] - l[0, 0, 0]
+
+  def flyFcn(l) -> float:
+    return l[0, 1, 0] - l[0, 0, 0]
+
+  def outFcn(c, x, y) -> float:
+    return c[0, 0, 0] - 0.025 * (x[0, 0, 0] - x[-1, 0, 0] +
+                                 y[0, 0, 0] - y[0, -1, 0])
+
+  lap = stencil.apply(atmp, lapFcn)
+  flx = stencil.apply(lap, flxFcn)
+  fly = stencil.apply(lap, flyFcn)
+  btmp = stencil.apply(atmp, flx, fly, outFcn)
+  stencil.store(b, btmp, [0, 0, 0], [{n}, {n}, {n}])
+  return
+""", 12, 1, 1),
+}
+
+def parse_list(text, convert=int):
+    return [convert(v) for v in text.split(",") if v]
+
+def parseArgs():
+    parser = argparse.ArgumentParser(description="Stencil benchmark suite")
+    parser.add_argument("--kernels", type=lambda s: parse_list(s, str),
+                        default=list(KERNELS), help="comma separated kernels")
+    parser.add_argument("--sizes", type=parse_list, default=[64, 128, 256],
+                        help="comma separated grid sizes")
+    parser.add_argument("--threads", type=parse_list, default=None,
+                        help="comma separated thread counts "
+                             "(default: 1 and powers of 2 up to the CPUs)")
+    parser.add_argument("--min-time", type=float, default=0.5,
+                        help="seconds to run each measurement for")
+    parser.add_argument("--format", choices=["csv", "json"], default="csv")
+    parser.add_argument("-o", "--output", help="write results to a file")
+    parser.add_argument("--worker", type=int, help=argparse.SUPPRESS)
+    return parser.parse_args()
+
+def default_threads():
+    cpus = os.cpu_count() or 1
+    threads = [1]
+    while threads[-1] * 2 < cpus:
+        threads.append(threads[-1] * 2)
+    if cpus > 1:
+        threads.append(cpus)
+    return threads
+
+def time_call(fcn, min_time):
+    """Median time of one call, over enough calls to fill `min_time`."""
+    fcn()
+    start = time.perf_counter()
+    fcn()
+    once = time.perf_counter() - start
+    times = []
+    for _ in range(max(5, int(min_time / max(once, 1e-6)))):
+        start = time.perf_counter()
+        fcn()
+        times.append(time.perf_counter() - start)
+    times.sort()
+    return times[len(times) // 2]
+
+def stream_bandwidth(dl_stencil):
+    # Arrays well past the last level cache, as STREAM requires.
+    size = 1 << 25
+    return 3 * 8 * size / dl_stencil.stream_triad(size)
+
+def run_worker(args):
+    os.environ["OEC_TARGET"] = "cpu"
+    import numpy as np
+    import dl_stencil
+    import stencil
+
+    threads = args.worker
+    bandwidth = stream_bandwidth(dl_stencil)
+    for name in args.kernels:
+        source, flops, inputs, outputs = KERNELS[name]
+        for n in args.sizes:
+            start = time.perf_counter()
+            fcn = stencil.program_source(source.format(
+                n=n, lb=-HALO, ub=n + HALO))
+            compile_secs = time.perf_counter() - start
+            if not fcn:
+                print("failed to compile {} for n={}".format(name, n),
+                      file=sys.stderr)
+                continue
+            shape = [n + 2 * HALO] * 3
+            a = np.random.rand(*shape)
+            b = np.zeros(shape)
+            secs = time_call(lambda: fcn(a, b), args.min_time)
+
+            points = n ** 3
+            moved = (inputs + outputs) * points * a.itemsize
+            achieved = moved / secs
+            print(json.dumps({
+                "kernel": name, "n": n, "threads": threads,
+                "seconds": secs, "compile_seconds": compile_secs,
+                "gflops": flops * points / secs / 1e9,
+                "gbytes_per_s": achieved / 1e9,
+                "intensity": flops / ((inputs + outputs) * a.itemsize),
+                "stream_gbytes_per_s": bandwidth / 1e9,
+                "roofline_percent": 100 * achieved / bandwidth,
+            }), flush=True)
+
+def run_driver(args):
+    unknown = [k for k in args.kernels if k not in KERNELS]
+    if unknown:
+        sys.exit("unknown kernels: " + ", ".join(unknown))
+    results = []
+    for threads in args.threads or default_threads():
+        env = dict(os.environ, OMP_NUM_THREADS=str(threads))
+        cmd = [sys.executable, os.path.abspath(__file__),
+               "--worker", str(threads),
+               "--kernels", ",".join(args.kernels),
+               "--sizes", ",".join(map(str, args.sizes)),
+               "--min-time", str(args.min_time)]
+        proc = subprocess.run(cmd, env=env, stdout=subprocess.PIPE, text=True)
+        results += [json.loads(line) for line in proc.stdout.splitlines()]
+        if proc.returncode != 0:
+            sys.exit("benchmark worker failed with {} threads".format(threads))
+
+    out = open(args.output, "w") if args.output else sys.stdout
+    if args.format == "json":
+        json.dump(results, out, indent=2)
+        out.write("\n")
+    elif results:
+        import csv
+        writer = csv.DictWriter(out, fieldnames=list(results[0]))
+        writer.writeheader()
+        writer.writerows(results)
+    if args.output:
+        out.close()
+
+def main():
+    args = parseArgs()
+    if args.worker:
+        run_worker(args)
+    else:
+        run_driver(args)
+
+if __name__ == "__main__":
+    main()
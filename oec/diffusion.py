@@ -0,0 +1,43 @@
+import stencil
+import numpy as np
+import time
+
+# Two-stage diffusion: a laplacian feeding a flux update. With fusion the
+# laplacian is recomputed at the two offsets the update reads instead of being
+# stored to a temporary. Run with OEC_FUSION=0 to time the unfused program.
+
+@stencil.program
+def diffusion(a, b):
+  stencil.cast(a, [-4, -4, -4], [68, 68, 68])
+  stencil.cast(b, [-4, -4, -4], [68, 68, 68])
+  atmp = stencil.load(a)
+
+  def laplaceFcn(c) -> float:
+    return 4 * c[0, 0, 0] - c[-1, 0, 0] - c[1, 0, 0] - c[0, 1, 0] - c[0, -1, 0]
+
+  def fluxFcn(c, d) -> float:
+    return c[0, 0, 0] - (d[1, 0, 0] - d[0, 0, 0])
+
+  lap = stencil.apply(atmp, laplaceFcn)
+  btmp = stencil.apply(atmp, lap, fluxFcn)
+  stencil.store(b, btmp, [0, 0, 0], [64, 64, 64])
+  return
+
+def reference(a):
+  # lap[x, y, z] is the laplacian at (x + 1, y + 1, z).
+  lap = (4 * a[1:-1, 1:-1] - a[:-2, 1:-1] - a[2:, 1:-1] -
+         a[1:-1, 2:] - a[1:-1, :-2])
+  flux = lap[4:68, 3:67, 4:68] - lap[3:67, 3:67, 4:68]
+  return a[4:68, 4:68, 4:68] - flux
+
+a = np.random.rand(72, 72, 72)
+b = np.zeros([72, 72, 72])
+diffusion(a, b)
+assert np.allclose(b[4:68, 4:68, 4:68], reference(a))
+
+runs = 100
+start = time.perf_counter()
+for _ in range(runs):
+  diffusion(a, b)
+elapsed = time.perf_counter() - start
+print("%.3f ms per call" % (1e3 * elapsed / runs))
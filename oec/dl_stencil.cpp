@@ -1,116 +1,626 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/functional.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
 
+#ifdef OEC_CUDA
 #include <cuda.h>
+#endif
 #include <dlfcn.h>
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
 #include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
-static void cuda_init() {
-  static CUdevice device;
-  static CUcontext context;
-  static bool inited{false};
+namespace py = pybind11;
 
-  if (!inited) {
-    inited = true;
-    cuInit(0);
-    cuDeviceGet(&device, 0);
-    cuCtxCreate(&context, 0, device);
-  }
+/// Descriptor of a 3D memref, as passed to `_mlir_ciface_` functions. Its
+/// layout does not depend on the element type, which is checked per field.
+template <typename IndexT>
+struct memref_3d_t {
+  void *allocatedPtr;
+  void *alignedPtr;
+  IndexT offset;
+  IndexT sizes[3];
+  IndexT strides[3];
+};
+
+/// Stencil functions take one descriptor pointer per field. Calls are
+/// dispatched on the field count through a table of fixed-arity callers.
+constexpr std::size_t MAX_FIELDS = 8;
+
+template <std::size_t, typename T> using repeat_t = T;
+
+template <typename DescT, std::size_t... Is>
+static void call_stencil(void *fcn, DescT *descs, std::index_sequence<Is...>) {
+  using fcn_t = void (*)(repeat_t<Is, DescT *>...);
+  reinterpret_cast<fcn_t>(fcn)(&descs[Is]...);
 }
 
-namespace py = pybind11;
+template <typename DescT, std::size_t N>
+static void call_stencil_n(void *fcn, DescT *descs) {
+  call_stencil(fcn, descs, std::make_index_sequence<N>{});
+}
+
+template <typename DescT, std::size_t... Ns>
+static constexpr auto make_stencil_callers(std::index_sequence<Ns...>) {
+  return std::array<void (*)(void *, DescT *), sizeof...(Ns)>{
+      &call_stencil_n<DescT, Ns>...};
+}
 
-// TODO f32
-struct stencil_t {
-  double *allocatedPtr;
-  double *alignedPtr;
-  int32_t offset;
-  int32_t sizes[3];
-  int32_t strides[3];
+/// A loaded stencil function: either its C interface, or the packed wrapper
+/// the JIT emits around it, which takes an array of pointers to its arguments.
+struct stencil_fcn_t {
+  void *addr;
+  bool packed;
 };
 
-using stencil_fcn_t = void (*)(stencil_t *, stencil_t *);
+template <typename DescT>
+static void call_stencil(stencil_fcn_t fcn, std::vector<DescT> &descs) {
+  if (fcn.packed) {
+    std::array<DescT *, MAX_FIELDS> desc_ptrs;
+    std::array<void *, MAX_FIELDS> args;
+    for (std::size_t i = 0; i < descs.size(); ++i) {
+      desc_ptrs[i] = &descs[i];
+      args[i] = &desc_ptrs[i];
+    }
+    reinterpret_cast<void (*)(void **)>(fcn.addr)(args.data());
+    return;
+  }
+  static constexpr auto callers =
+      make_stencil_callers<DescT>(std::make_index_sequence<MAX_FIELDS + 1>{});
+  callers[descs.size()](fcn.addr, descs.data());
+}
 
+/// The buffer format of a stencil element type, "f32" or "f64".
+static std::string element_format(const std::string &type) {
+  if (type == "f32") {
+    return py::format_descriptor<float>::format();
+  }
+  if (type == "f64") {
+    return py::format_descriptor<double>::format();
+  }
+  throw std::runtime_error{"unsupported element type: " + type};
+}
+
+/// Bytes spanned by a buffer, from its first element to past its last.
 static std::size_t compute_mem_size(py::buffer_info &info) {
   std::size_t size = info.itemsize;
   for (py::ssize_t i = 0; i < info.ndim; ++i) {
-    size *= info.shape[i];
+    if (info.shape[i] > 0) {
+      size += info.strides[i] * (info.shape[i] - 1);
+    }
   }
   return size;
 }
 
-extern "C" {
-  void mgpuMemAlloc(CUdeviceptr *ptr, uint64_t size);
-  void mgpuMemFree(CUdeviceptr ptr);
+/// The fields of one stencil function: their element types, which ones are
+/// written, the shapes they were compiled for, and the layout of the last set
+/// of arrays that passed validation.
+/// Arrays are only validated again when a call passes a different layout.
+class field_set_t {
+public:
+  field_set_t(const std::vector<std::string> &types,
+              const std::vector<std::size_t> &outputs,
+              const std::vector<std::vector<py::ssize_t>> &shapes)
+      : types(types), shapes(shapes), writable(types.size()) {
+    if (shapes.size() != types.size()) {
+      throw std::runtime_error{"expected a shape for every field"};
+    }
+    if (types.size() > MAX_FIELDS) {
+      throw std::runtime_error{"too many fields: at most " +
+                               std::to_string(MAX_FIELDS) + " are supported"};
+    }
+    for (auto &type : types) {
+      formats.push_back(element_format(type));
+    }
+    for (auto idx : outputs) {
+      writable.at(idx) = true;
+    }
+  }
+
+  template <typename IndexT>
+  std::vector<py::buffer_info> request(py::args args) {
+    if (args.size() != writable.size()) {
+      throw std::runtime_error{"expected " + std::to_string(writable.size()) +
+                               " fields, got " + std::to_string(args.size())};
+    }
+    std::vector<py::buffer_info> infos;
+    std::vector<py::ssize_t> layout;
+    infos.reserve(args.size());
+    for (std::size_t i = 0; i < args.size(); ++i) {
+      infos.push_back(args[i].cast<py::buffer>().request(writable[i]));
+      auto &info = infos.back();
+      layout.push_back(info.itemsize);
+      layout.push_back(info.format.empty() ? 0 : info.format[0]);
+      layout.insert(layout.end(), info.shape.begin(), info.shape.end());
+      layout.insert(layout.end(), info.strides.begin(), info.strides.end());
+    }
+    if (layout != validated) {
+      for (std::size_t i = 0; i < infos.size(); ++i) {
+        check_field<IndexT>(infos[i], i, formats[i], types[i], shapes[i]);
+      }
+      validated = std::move(layout);
+    }
+    check_aliasing(infos);
+    return infos;
+  }
+
+private:
+  /// The chunks of a CPU stencil run in parallel on the arrays in place, so a
+  /// field written by the stencil must not share memory with any other field:
+  /// one chunk would overwrite the halo another chunk reads. This depends on
+  /// the addresses, not the layout, so it runs on every call.
+  void check_aliasing(std::vector<py::buffer_info> &infos) const {
+    for (std::size_t i = 0; i < infos.size(); ++i) {
+      if (!writable[i]) {
+        continue;
+      }
+      auto *begin = static_cast<char *>(infos[i].ptr);
+      auto *end = begin + compute_mem_size(infos[i]);
+      for (std::size_t j = 0; j < infos.size(); ++j) {
+        auto *other = static_cast<char *>(infos[j].ptr);
+        if (j == i || other >= end ||
+            other + compute_mem_size(infos[j]) <= begin) {
+          continue;
+        }
+        throw std::runtime_error{"field " + std::to_string(j) +
+                                 " overlaps field " + std::to_string(i) +
+                                 ", which the stencil writes"};
+      }
+    }
+  }
+
+  template <typename IndexT>
+  static void check_field(py::buffer_info &info, std::size_t idx,
+                          const std::string &format, const std::string &type,
+                          const std::vector<py::ssize_t> &shape) {
+    auto error = [idx](const std::string &msg) {
+      return std::runtime_error{"field " + std::to_string(idx) + ": " + msg};
+    };
+    if (info.ndim != 3) {
+      throw error("incompatible shape: expected 3D array");
+    }
+    // The kernel accesses every point of the bounds it was compiled for.
+    if (info.shape != shape) {
+      throw error("incompatible shape: expected " + format_shape(shape) +
+                  ", got " + format_shape(info.shape));
+    }
+    if (info.format != format) {
+      throw error("incompatible format: expected " + type);
+    }
+    // The kernels index the innermost dimension contiguously; the other
+    // strides can be anything the descriptor can represent.
+    if (info.strides[2] != info.itemsize) {
+      throw error("incompatible layout: innermost dimension is not contiguous");
+    }
+    for (int i = 0; i < 3; ++i) {
+      if (info.strides[i] < 0) {
+        throw error("incompatible layout: negative stride");
+      }
+    }
+    // Sizes, strides and the linear indices computed from them must all fit
+    // the kernel's index type.
+    constexpr auto max_index = std::numeric_limits<IndexT>::max();
+    py::ssize_t extent = 1;
+    for (int i = 0; i < 3; ++i) {
+      if (info.strides[i] % info.itemsize != 0) {
+        throw error("incompatible layout: misaligned stride");
+      }
+      auto stride = info.strides[i] / info.itemsize;
+      if (info.shape[i] > max_index || stride > max_index) {
+        throw error("array too large for the kernel's index type");
+      }
+      if (info.shape[i] > 0) {
+        extent += stride * (info.shape[i] - 1);
+      }
+    }
+    if (extent > max_index) {
+      throw error("array too large for the kernel's index type");
+    }
+  }
+
+  static std::string format_shape(const std::vector<py::ssize_t> &shape) {
+    std::string ret = "(";
+    for (std::size_t i = 0; i < shape.size(); ++i) {
+      ret += (i ? ", " : "") + std::to_string(shape[i]);
+    }
+    return ret + ")";
+  }
+
+  std::vector<std::string> types;
+  std::vector<std::string> formats;
+  std::vector<std::vector<py::ssize_t>> shapes;
+  std::vector<bool> writable;
+  std::vector<py::ssize_t> validated;
+};
+
+/// Describe a buffer in place, in elements, without copying it.
+template <typename IndexT>
+static memref_3d_t<IndexT> make_memref(py::buffer_info &info, void *ptr) {
+  memref_3d_t<IndexT> ret{ptr, ptr, 0, {}, {}};
+  for (int i = 0; i < 3; ++i) {
+    ret.sizes[i] = static_cast<IndexT>(info.shape[i]);
+    ret.strides[i] = static_cast<IndexT>(info.strides[i] / info.itemsize);
+  }
+  return ret;
 }
 
-static std::function<void(py::buffer, py::buffer)>
-bind_stencil(std::string sym_name, std::string dl_name) {
+static std::optional<stencil_fcn_t>
+load_stencil(const std::string &sym_name, const std::string &dl_name) {
   void *handle = dlopen(dl_name.c_str(), RTLD_LAZY | RTLD_NODELETE);
   if (char *err = dlerror()) {
     std::cerr << "dlopen(" << dl_name << ") error: " << err << std::endl;
-    return nullptr;
+    return std::nullopt;
   }
   std::string ciface_sym = "_mlir_ciface_" + sym_name;
   void *fcn_handle = dlsym(handle, ciface_sym.c_str());
   if (char *err = dlerror(); fcn_handle == nullptr) {
     std::cerr << "dlsym(" << ciface_sym << ") error: " << err << std::endl;
-    return nullptr;
+    return std::nullopt;
   }
-  stencil_fcn_t stencil_fcn = reinterpret_cast<stencil_fcn_t>(fcn_handle);
-  // TODO more than one input/output
-  return [stencil_fcn](py::buffer input, py::buffer output) {
-    py::buffer_info input_info = input.request();
-    py::buffer_info output_info = output.request();
+  return stencil_fcn_t{fcn_handle, false};
+}
+
+/// Wrap the address of a packed stencil function compiled by jit_stencil.
+static stencil_fcn_t packed_stencil(uintptr_t addr) {
+  return stencil_fcn_t{reinterpret_cast<void *>(addr), true};
+}
 
-    if (input_info.ndim != 3) {
-      throw std::runtime_error{"incompatible input shape: expected 3D array"};
+#ifdef OEC_CUDA
+extern "C" {
+  void mgpuMemAlloc(CUdeviceptr *ptr, uint64_t size);
+  void mgpuMemFree(CUdeviceptr ptr);
+}
+#endif
+
+/// Buffers are aligned to a cache line, which also covers the widest vector.
+constexpr std::size_t BUFFER_ALIGN = 64;
+
+/// Buffers of the same layout, kept for reuse across stencil calls. Calls of
+/// a time-stepping loop ask for the same buffers over and over, so each layout
+/// settles into a handful of buffers that are allocated once.
+///
+/// A layout is the shape of a field including its halo, the halo width, the
+/// element size, and whether it lives on the device. Host buffers are offset
+/// so that the first interior point, [halo, halo, halo], is aligned. Kernel
+/// temporaries are only known by their size in bytes, and use it as the shape.
+class buffer_pool_t {
+public:
+  struct key_t {
+    std::array<int64_t, 3> shape;
+    int64_t halo;
+    int64_t itemsize;
+    bool device;
+
+    bool operator<(const key_t &other) const {
+      return std::tie(shape, halo, itemsize, device) <
+             std::tie(other.shape, other.halo, other.itemsize, other.device);
     }
-    if (output_info.ndim != 3) {
-      throw std::runtime_error{"incompatible output shape: expected 3D array"};
+
+    std::size_t bytes() const {
+      return shape[0] * shape[1] * shape[2] * itemsize;
     }
 
-    if (input_info.format != py::format_descriptor<double>::format()) {
-      throw std::runtime_error{"incompatible input format: expected f64"};
+    /// Byte offset of the first interior point in a row-major buffer.
+    std::size_t origin() const {
+      return halo * (shape[1] * shape[2] + shape[2] + 1) * itemsize;
     }
-    if (output_info.format != py::format_descriptor<double>::format()) {
-      throw std::runtime_error{"incompatible output format: expected f64"};
+  };
+
+  struct stats_t {
+    std::size_t allocations = 0;
+    std::size_t reuses = 0;
+    std::size_t bytes_in_use = 0;
+    std::size_t bytes_idle = 0;
+    std::size_t peak_bytes = 0;
+  };
+
+  static buffer_pool_t &get() {
+    // Leaked so that buffers released during interpreter teardown still
+    // find the pool.
+    static auto *pool = new buffer_pool_t;
+    return *pool;
+  }
+
+  void *acquire(const key_t &key) {
+    std::lock_guard<std::mutex> lock{mutex};
+    buffer_t buffer;
+    auto &idle = free_lists[key];
+    if (!idle.empty()) {
+      buffer = idle.back();
+      idle.pop_back();
+      stats.bytes_idle -= buffer.bytes;
+      ++stats.reuses;
+    } else {
+      buffer = allocate(key);
+      ++stats.allocations;
+    }
+    stats.bytes_in_use += buffer.bytes;
+    stats.peak_bytes = std::max(stats.peak_bytes,
+                                stats.bytes_in_use + stats.bytes_idle);
+    in_use.emplace(buffer.data, std::make_pair(key, buffer));
+    return buffer.data;
+  }
+
+  void release(void *data) {
+    if (!data) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock{mutex};
+    auto it = in_use.find(data);
+    if (it == in_use.end()) {
+      throw std::runtime_error{"released a buffer that is not in the pool"};
     }
+    auto [key, buffer] = it->second;
+    in_use.erase(it);
+    stats.bytes_in_use -= buffer.bytes;
+    stats.bytes_idle += buffer.bytes;
+    free_lists[key].push_back(buffer);
+  }
 
-    std::size_t input_mem_size = compute_mem_size(input_info);
-    std::size_t output_mem_size = compute_mem_size(output_info);
+  /// Free every idle buffer.
+  void trim() {
+    std::lock_guard<std::mutex> lock{mutex};
+    for (auto &[key, idle] : free_lists) {
+      for (auto &buffer : idle) {
+        deallocate(key, buffer);
+        stats.bytes_idle -= buffer.bytes;
+      }
+      idle.clear();
+    }
+  }
 
-    CUdeviceptr input_mem_ptr{}, output_mem_ptr{};
-    mgpuMemAlloc(&input_mem_ptr, input_mem_size);
-    mgpuMemAlloc(&output_mem_ptr, output_mem_size);
+  stats_t get_stats() {
+    std::lock_guard<std::mutex> lock{mutex};
+    return stats;
+  }
 
-    cuMemcpyHtoD(input_mem_ptr, input_info.ptr, input_mem_size);
+private:
+  struct buffer_t {
+    void *base;
+    void *data;
+    std::size_t bytes;
+  };
 
-    stencil_t input_stencil{
-      (double *) input_mem_ptr, (double *) input_mem_ptr, 0,
-      { input_info.shape[0], input_info.shape[1], input_info.shape[2] },
-      { input_info.strides[0], input_info.strides[1], input_info.strides[2] }
-    };
-    stencil_t output_stencil{
-      (double *) output_mem_ptr, (double *) output_mem_ptr, 0,
-      { output_info.shape[0], output_info.shape[1], output_info.shape[2] },
-      { output_info.strides[0], output_info.strides[1], output_info.strides[2] },
-    };
+  static buffer_t allocate(const key_t &key) {
+    auto bytes = key.bytes();
+#ifdef OEC_CUDA
+    if (key.device) {
+      CUdeviceptr ptr;
+      mgpuMemAlloc(&ptr, bytes);
+      return {(void *) ptr, (void *) ptr, bytes};
+    }
+#endif
+    auto *base = static_cast<char *>(std::malloc(bytes + BUFFER_ALIGN));
+    if (!base) {
+      throw std::bad_alloc{};
+    }
+    auto origin = reinterpret_cast<uintptr_t>(base) + key.origin();
+    auto pad = (BUFFER_ALIGN - origin % BUFFER_ALIGN) % BUFFER_ALIGN;
+    return {base, base + pad, bytes};
+  }
+
+  static void deallocate(const key_t &key, buffer_t &buffer) {
+#ifdef OEC_CUDA
+    if (key.device) {
+      mgpuMemFree((CUdeviceptr) buffer.base);
+      return;
+    }
+#endif
+    std::free(buffer.base);
+  }
+
+  std::mutex mutex;
+  std::map<key_t, std::vector<buffer_t>> free_lists;
+  std::unordered_map<void *, std::pair<key_t, buffer_t>> in_use;
+  stats_t stats;
+};
+
+/// The allocator CPU kernels call for their temporaries in place of `malloc`
+/// and `free`. The symbols are exported so that kernels loaded or compiled
+/// into the process resolve to them.
+extern "C" __attribute__((visibility("default")))
+void *oec_pool_alloc(uint64_t size) {
+  return buffer_pool_t::get().acquire({{(int64_t) size, 1, 1}, 0, 1, false});
+}
+
+extern "C" __attribute__((visibility("default")))
+void oec_pool_free(void *ptr) {
+  buffer_pool_t::get().release(ptr);
+}
 
-    stencil_fcn(&input_stencil, &output_stencil);
+/// A NumPy array backed by a pooled host buffer, which goes back to the pool
+/// when the array is collected. Its first interior point is aligned.
+static py::array pool_array(std::array<int64_t, 3> shape, int64_t halo,
+                            py::dtype dtype) {
+  auto itemsize = static_cast<int64_t>(dtype.itemsize());
+  auto *data = buffer_pool_t::get().acquire({shape, halo, itemsize, false});
+  py::capsule owner{data, [](void *data) {
+    buffer_pool_t::get().release(data);
+  }};
+  return py::array{dtype, shape, data, owner};
+}
 
-    cuMemcpyDtoH(output_info.ptr, output_mem_ptr, output_mem_size);
+static py::dict pool_stats() {
+  auto stats = buffer_pool_t::get().get_stats();
+  py::dict ret;
+  ret["allocations"] = stats.allocations;
+  ret["reuses"] = stats.reuses;
+  ret["bytes_in_use"] = stats.bytes_in_use;
+  ret["bytes_idle"] = stats.bytes_idle;
+  ret["peak_bytes"] = stats.peak_bytes;
+  return ret;
+}
 
-    mgpuMemFree(input_mem_ptr);
-    mgpuMemFree(input_mem_ptr);
+/// Make the pool allocator visible to kernels: Python loads extension modules
+/// with RTLD_LOCAL, so promote this one to the global symbol scope.
+static void export_pool_symbols() {
+  Dl_info info;
+  if (dladdr((void *) &oec_pool_alloc, &info) && info.dli_fname) {
+    dlopen(info.dli_fname, RTLD_LAZY | RTLD_NOLOAD | RTLD_GLOBAL);
+  }
+}
+
+using stencil_binding_t = std::function<void(py::args)>;
+
+#ifdef OEC_CUDA
+
+static void cuda_init() {
+  static CUdevice device;
+  static CUcontext context;
+  static bool inited{false};
+
+  if (!inited) {
+    inited = true;
+    cuInit(0);
+    cuDeviceGet(&device, 0);
+    cuCtxCreate(&context, 0, device);
+  }
+}
+
+// GPU kernels are lowered with 32-bit indices.
+using stencil_t = memref_3d_t<int32_t>;
+
+/// Bind a GPU stencil function of fields of element `types` and `shapes`.
+/// Every field is copied to the device before the call, and `outputs` are
+/// copied back after.
+static stencil_binding_t
+bind_stencil(stencil_fcn_t stencil_fcn, std::vector<std::string> types,
+             std::vector<std::size_t> outputs,
+             std::vector<std::vector<py::ssize_t>> shapes) {
+  auto fields = std::make_shared<field_set_t>(types, outputs, shapes);
+  return [stencil_fcn, fields, outputs](py::args args) {
+    auto infos = fields->request<int32_t>(args);
+
+    // Staging buffers come from the pool, keyed by the span each field
+    // covers, so repeated calls on the same arrays allocate nothing.
+    auto &pool = buffer_pool_t::get();
+    std::vector<CUdeviceptr> mem_ptrs(infos.size());
+    std::vector<stencil_t> stencils;
+    for (std::size_t i = 0; i < infos.size(); ++i) {
+      auto mem_size = compute_mem_size(infos[i]);
+      mem_ptrs[i] = (CUdeviceptr) pool.acquire(
+          {{(int64_t) mem_size, 1, 1}, 0, 1, true});
+      cuMemcpyHtoD(mem_ptrs[i], infos[i].ptr, mem_size);
+      stencils.push_back(make_memref<int32_t>(infos[i],
+                                              (void *) mem_ptrs[i]));
+    }
+
+    call_stencil(stencil_fcn, stencils);
+
+    for (auto idx : outputs) {
+      cuMemcpyDtoH(infos[idx].ptr, mem_ptrs[idx],
+                   compute_mem_size(infos[idx]));
+    }
+    for (auto mem_ptr : mem_ptrs) {
+      pool.release((void *) mem_ptr);
+    }
+  };
+}
+
+#endif // OEC_CUDA
+
+// CPU kernels are lowered with the default 64-bit indices.
+using cpu_stencil_t = memref_3d_t<int64_t>;
+
+/// Bind a CPU stencil function of fields of element `types` and `shapes`,
+/// compiled for one chunk of `rows` rows of the outermost dimension. Each call
+/// runs `chunks` instances of it in parallel, with every field shifted by a
+/// whole chunk. The descriptors point straight at the NumPy buffers.
+static stencil_binding_t
+bind_cpu_stencil(stencil_fcn_t stencil_fcn, std::vector<std::string> types,
+                 std::vector<std::size_t> outputs,
+                 std::vector<std::vector<py::ssize_t>> shapes, int64_t chunks,
+                 int64_t rows) {
+  auto fields = std::make_shared<field_set_t>(types, outputs, shapes);
+  return [stencil_fcn, fields, chunks, rows](py::args args) {
+    auto infos = fields->request<int64_t>(args);
+    std::vector<cpu_stencil_t> stencils;
+    for (auto &info : infos) {
+      stencils.push_back(make_memref<int64_t>(info, info.ptr));
+    }
+
+    py::gil_scoped_release release;
+#pragma omp parallel for schedule(static)
+    for (int64_t chunk = 0; chunk < chunks; ++chunk) {
+      auto chunk_stencils = stencils;
+      for (std::size_t i = 0; i < chunk_stencils.size(); ++i) {
+        auto *ptr = static_cast<char *>(chunk_stencils[i].alignedPtr);
+        chunk_stencils[i].alignedPtr = ptr + chunk * rows * infos[i].strides[0];
+      }
+      call_stencil(stencil_fcn, chunk_stencils);
+    }
   };
 }
 
+/// The STREAM triad `a = b + scalar * c` over `size` doubles, on as many
+/// threads as the stencils get. Returns the best of `repeats` times in
+/// seconds; the bandwidth is 3 * 8 * size bytes over that time, as STREAM
+/// counts it. This is the roofline the stencil benchmarks are measured against.
+static double stream_triad(std::size_t size, int repeats) {
+  // Every array is first touched by the thread that works on it, so pages land
+  // on that thread's memory node as they do for the stencils' chunks.
+  std::unique_ptr<double[]> a{new double[size]};
+  std::unique_ptr<double[]> b{new double[size]};
+  std::unique_ptr<double[]> c{new double[size]};
+  auto n = static_cast<int64_t>(size);
+#pragma omp parallel for schedule(static)
+  for (int64_t i = 0; i < n; ++i) {
+    a[i] = 0;
+    b[i] = 1;
+    c[i] = 2;
+  }
+
+  py::gil_scoped_release release;
+  using Clock = std::chrono::steady_clock;
+  double best = std::numeric_limits<double>::infinity();
+  constexpr double scalar = 3;
+  for (int r = 0; r < repeats; ++r) {
+    auto start = Clock::now();
+#pragma omp parallel for schedule(static)
+    for (int64_t i = 0; i < n; ++i) {
+      a[i] = b[i] + scalar * c[i];
+    }
+    std::chrono::duration<double> secs = Clock::now() - start;
+    best = std::min(best, secs.count());
+  }
+  return best;
+}
+
 PYBIND11_MODULE(dl_stencil, m) {
   m.doc() = "Stencil Dynamic Library Binding";
 
+  py::class_<stencil_fcn_t>(m, "StencilFunction");
+  m.def("load_stencil", &load_stencil);
+  m.def("packed_stencil", &packed_stencil);
+
+#ifdef OEC_CUDA
+  m.attr("has_cuda") = true;
   m.def("cuda_init", &cuda_init);
   m.def("bind_stencil", &bind_stencil);
+#else
+  m.attr("has_cuda") = false;
+#endif
+  m.def("bind_cpu_stencil", &bind_cpu_stencil);
+  m.def("stream_triad", &stream_triad, py::arg("size"),
+        py::arg("repeats") = 10);
+
+  export_pool_symbols();
+  m.def("pool_array", &pool_array, py::arg("shape"), py::arg("halo"),
+        py::arg("dtype"));
+  m.def("pool_stats", &pool_stats);
+  m.def("pool_trim", [] { buffer_pool_t::get().trim(); });
 }
@@ -0,0 +1,206 @@
+#include "Conversion/StencilToStandard/Passes.h"
+#include "Dialect/Stencil/Passes.h"
+#include "Dialect/Stencil/StencilDialect.h"
+
+#include <mlir/Dialect/LLVMIR/LLVMDialect.h>
+#include <mlir/ExecutionEngine/ExecutionEngine.h>
+#include <mlir/ExecutionEngine/OptUtils.h>
+#include <mlir/IR/Diagnostics.h>
+#include <mlir/IR/MLIRContext.h>
+#include <mlir/IR/Module.h>
+#include <mlir/IR/SymbolTable.h>
+#include <mlir/InitAllDialects.h>
+#include <mlir/InitAllPasses.h>
+#include <mlir/Parser.h>
+#include <mlir/Pass/PassManager.h>
+#include <mlir/Pass/PassRegistry.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/TargetSelect.h>
+
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace py = pybind11;
+
+static void init_native_target() {
+  static bool inited = [] {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    return true;
+  }();
+  (void) inited;
+}
+
+/// The context stencil modules are compiled in. Dialects and passes are
+/// registered the way oec-opt registers them, before the context is created.
+static mlir::MLIRContext &get_context() {
+  static mlir::MLIRContext &context = [&]() -> mlir::MLIRContext & {
+    mlir::registerAllDialects();
+    mlir::registerAllPasses();
+    mlir::registerStencilPasses();
+    mlir::registerStencilConversionPasses();
+    mlir::registerDialect<mlir::stencil::StencilDialect>();
+    init_native_target();
+    return *new mlir::MLIRContext;
+  }();
+  return context;
+}
+
+using rename_map_t = std::map<std::string, std::string>;
+
+/// Compiled stencil functions are handed out as raw addresses, so their
+/// engines are kept for the life of the process, like a dlopen'd kernel.
+static std::vector<std::unique_ptr<mlir::ExecutionEngine>> engines;
+static std::vector<std::unique_ptr<llvm::orc::LLJIT>> loaded_objects;
+
+/// The ExecutionEngine exposes a packed wrapper of each function under this
+/// name; the wrapper is part of the object code it emits.
+static std::string packed_name(const std::string &sym_name) {
+  return "_mlir__mlir_ciface_" + sym_name;
+}
+
+/// Compile a stencil module in-process: parse it, run `pipeline` down to the
+/// LLVM dialect and JIT it for the host at `opt_level`. Functions the lowered
+/// module calls are renamed according to `renames`, e.g. to route `malloc`
+/// to another allocator. Returns the address of the packed wrapper of
+/// `_mlir_ciface_<sym_name>`, which takes an array of pointers to its
+/// arguments, and the compile time in seconds. If `object_file` is given, the
+/// generated object code is also written there for `load_stencil`.
+static py::tuple compile_stencil(const std::string &source,
+                                 const std::string &pipeline,
+                                 const std::string &sym_name,
+                                 unsigned opt_level,
+                                 const rename_map_t &renames,
+                                 const std::string &object_file) {
+  using Clock = std::chrono::steady_clock;
+  auto &context = get_context();
+  auto start = Clock::now();
+
+  // Report diagnostics through the exception rather than stderr.
+  std::string diags;
+  llvm::raw_string_ostream diag_os{diags};
+  mlir::ScopedDiagnosticHandler handler{&context, [&](mlir::Diagnostic &diag) {
+    diag_os << diag.getLocation() << ": " << diag << "\n";
+    return mlir::success();
+  }};
+  auto fail = [&](const std::string &what) {
+    return std::runtime_error{what + ":\n" + diag_os.str()};
+  };
+
+  llvm::SourceMgr source_mgr;
+  source_mgr.AddNewSourceBuffer(
+      llvm::MemoryBuffer::getMemBuffer(source, sym_name), llvm::SMLoc{});
+  mlir::OwningModuleRef module = mlir::parseSourceFile(source_mgr, &context);
+  if (!module) {
+    throw fail("failed to parse stencil module");
+  }
+
+  mlir::PassManager pm{&context};
+  if (failed(mlir::parsePassPipeline(pipeline, pm, diag_os))) {
+    throw fail("invalid pass pipeline");
+  }
+  if (failed(pm.run(*module))) {
+    throw fail("failed to lower stencil module");
+  }
+  for (auto &[from, to] : renames) {
+    auto fcn = module->lookupSymbol<mlir::LLVM::LLVMFuncOp>(from);
+    if (!fcn) {
+      continue;
+    }
+    if (failed(mlir::SymbolTable::replaceAllSymbolUses(fcn, to, *module))) {
+      throw fail("failed to rename " + from);
+    }
+    mlir::SymbolTable::setSymbolName(fcn, to);
+  }
+
+  // Optimize for the host so the vectorizer sees its real vector width.
+  auto tm_builder = llvm::orc::JITTargetMachineBuilder::detectHost();
+  if (!tm_builder) {
+    throw std::runtime_error{llvm::toString(tm_builder.takeError())};
+  }
+  auto tm = tm_builder->createTargetMachine();
+  if (!tm) {
+    throw std::runtime_error{llvm::toString(tm.takeError())};
+  }
+  auto transformer = mlir::makeOptimizingTransformer(
+      opt_level, /*sizeLevel=*/0, tm->get());
+  auto engine = mlir::ExecutionEngine::create(
+      *module, /*llvmModuleBuilder=*/nullptr, transformer,
+      static_cast<llvm::CodeGenOpt::Level>(opt_level),
+      /*sharedLibPaths=*/{}, /*enableObjectCache=*/!object_file.empty());
+  if (!engine) {
+    throw std::runtime_error{"failed to JIT stencil module: " +
+                             llvm::toString(engine.takeError())};
+  }
+  // Lookup materializes the code, so it counts as compile time.
+  auto fcn = (*engine)->lookup("_mlir_ciface_" + sym_name);
+  if (!fcn) {
+    throw std::runtime_error{"failed to find stencil function: " +
+                             llvm::toString(fcn.takeError())};
+  }
+  if (!object_file.empty()) {
+    (*engine)->dumpToObjectFile(object_file);
+  }
+  engines.push_back(std::move(*engine));
+
+  std::chrono::duration<double> seconds = Clock::now() - start;
+  return py::make_tuple(reinterpret_cast<uintptr_t>(*fcn), seconds.count());
+}
+
+/// Load object code written by `compile_stencil` into the process. External
+/// symbols, e.g. the pool allocator, resolve against the process as they do
+/// for the JIT. Returns the address of the packed wrapper of
+/// `_mlir_ciface_<sym_name>`.
+static uintptr_t load_stencil(const std::string &object_file,
+                              const std::string &sym_name) {
+  init_native_target();
+  auto fail = [&](const std::string &what, llvm::Error err) {
+    return std::runtime_error{what + " " + object_file + ": " +
+                              llvm::toString(std::move(err))};
+  };
+
+  auto buffer = llvm::MemoryBuffer::getFile(object_file);
+  if (!buffer) {
+    throw std::runtime_error{"failed to read " + object_file + ": " +
+                             buffer.getError().message()};
+  }
+  auto jit = llvm::orc::LLJITBuilder().create();
+  if (!jit) {
+    throw fail("failed to create a JIT for", jit.takeError());
+  }
+  auto generator =
+      llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+          (*jit)->getDataLayout().getGlobalPrefix());
+  if (!generator) {
+    throw fail("failed to resolve symbols of", generator.takeError());
+  }
+  (*jit)->getMainJITDylib().addGenerator(std::move(*generator));
+  if (auto err = (*jit)->addObjectFile(std::move(*buffer))) {
+    throw fail("failed to load", std::move(err));
+  }
+  auto fcn = (*jit)->lookup(packed_name(sym_name));
+  if (!fcn) {
+    throw fail("failed to find stencil function in", fcn.takeError());
+  }
+  loaded_objects.push_back(std::move(*jit));
+  return static_cast<uintptr_t>(fcn->getAddress());
+}
+
+PYBIND11_MODULE(jit_stencil, m) {
+  m.doc() = "In-process Stencil Compiler";
+
+  m.def("compile", &compile_stencil, py::arg("source"), py::arg("pipeline"),
+        py::arg("sym_name"), py::arg("opt_level") = 3,
+        py::arg("renames") = rename_map_t{}, py::arg("object_file") = "");
+  m.def("load", &load_stencil, py::arg("object_file"), py::arg("sym_name"));
+}
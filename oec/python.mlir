@@ -76,7 +76,7 @@ Dialect @py {
     traits [@NoSideEffects]
     config { fmt = "$op $arg attr-dict" }
 
-  Alias @BinOp -> #dmc.AnyOf<"+", "*">
+  Alias @BinOp -> #dmc.AnyOf<"+", "-", "*">
   Op @binary(lhs: !py.obj, rhs: !py.obj) -> (res: !py.obj)
     { op = #py.BinOp }
     traits [@NoSideEffects]
@@ -30,6 +30,36 @@ def nonnull_handle(v):
 def load_ctx(n):
     return isinstance(n.ctx, ast.Load)
 
+# Spellings of the supported element types, as NumPy dtype names, Python types
+# or MLIR types. Fields are f64 unless annotated otherwise.
+element_types = {
+    "f32": F32Type, "float32": F32Type, "single": F32Type,
+    "f64": F64Type, "float64": F64Type, "double": F64Type, "float": F64Type,
+}
+
+def element_type(name):
+    if name not in element_types:
+        raise NotImplementedError("unsupported element type: " + str(name))
+    return element_types[name]()
+
+def dtype_element_type(dtype):
+    """The element type of a dtype-like object, e.g. np.float32 or "f32"."""
+    if isinstance(dtype, str):
+        return element_type(dtype)
+    return element_type(getattr(dtype, "name", None) or dtype.__name__)
+
+def annotation_element_type(node):
+    """The element type named by a field annotation such as `np.float32`."""
+    if node == None:
+        return F64Type()
+    if isinstance(node, ast.Constant) and isinstance(node.value, str):
+        return element_type(node.value)
+    if isinstance(node, ast.Name):
+        return element_type(node.id)
+    if isinstance(node, ast.Attribute):
+        return element_type(node.attr)
+    raise NotImplementedError("field annotation: " + ast.dump(node))
+
 class StencilProgramVisitor(ast.NodeVisitor):
 
     def __init__(self):
@@ -52,6 +82,8 @@ class StencilProgramVisitor(ast.NodeVisitor):
         self.b.insertAtStart(self.m.getRegion(0).getBlock(0))
         for funcDef in node.body:
             assert isinstance(funcDef, ast.FunctionDef)
+            self.fieldTypes = [annotation_element_type(arg.annotation)
+                               for arg in funcDef.args.args]
             self.visit(funcDef)
         return self.m
 
@@ -92,7 +124,7 @@ class StencilProgramVisitor(ast.NodeVisitor):
 
     def visit_arg(self, node):
         assert node.type_comment == None
-        # TODO check type annotation
+        # Field annotations are read by visit_Module.
         return node.arg, py.object()
 
     def visit_Assign(self, node):
@@ -151,6 +183,8 @@ class StencilProgramVisitor(ast.NodeVisitor):
     def visit_Constant(self, node):
         if isinstance(node.value, int):
             value = I64Attr(node.value)
+        elif isinstance(node.value, float):
+            value = F64Attr(node.value)
         else:
             raise NotImplementedError("constant type: " + str(type(node.value)))
         return self.b.create(py.constant, value=value,
@@ -190,6 +224,9 @@ class StencilProgramVisitor(ast.NodeVisitor):
     def visit_Add(self, node):
         return "+"
 
+    def visit_Sub(self, node):
+        return "-"
+
     def visit_Mult(self, node):
         return "*"
 
@@ -318,8 +355,21 @@ def get_index(arg):
     assert isa(arg.definingOp, tmp.stencil_index)
     return tmp.stencil_index(arg.definingOp).index()
 
-def convert_stencil_sig(sig):
-    args = [tmp.unshaped_f64_field() for field in sig.inputs]
+def field_type(elementType):
+    return (tmp.unshaped_f32_field() if elementType == F32Type() else
+            tmp.unshaped_f64_field())
+
+def temp_type(elementType):
+    return (tmp.unshaped_f32_temp() if elementType == F32Type() else
+            tmp.unshaped_f64_temp())
+
+def grid_element_type(ty):
+    return (F32Type() if ty in (tmp.unshaped_f32_field(),
+                                tmp.unshaped_f32_temp()) else F64Type())
+
+def convert_stencil_sig(sig, fieldTypes):
+    assert len(fieldTypes) == len(sig.inputs)
+    args = [field_type(ty) for ty in fieldTypes]
     rets = [tmp.unshaped_f64_field() for field in sig.results]
     return FunctionType(args, rets)
 
@@ -327,20 +377,22 @@ def copy_into(newBlk, oldBlk, bvm):
     for oldOp in oldBlk:
         newBlk.append(oldOp.clone(bvm))
 
-def raiseStencilProgram(op, b):
-    if not op.parentOp or not isa(op.parentOp, ModuleOp):
-        return False
-    func = b.create(FuncOp, name=op.name().getValue(),
-                    type=convert_stencil_sig(op.sig().type),
-                    attrs={"stencil.program":UnitAttr()})
-    bvm = BlockAndValueMapping()
-    entry = func.addEntryBlock()
-    body = op.body().getBlock(0)
-    for field, obj in zip(entry.getArguments(), body.getArguments()):
-        bvm[obj] = field
-    copy_into(entry, body, bvm)
-    b.erase(op)
-    return True
+def raiseStencilProgram(fieldTypes):
+    def patternFcn(op, b):
+        if not op.parentOp or not isa(op.parentOp, ModuleOp):
+            return False
+        func = b.create(FuncOp, name=op.name().getValue(),
+                        type=convert_stencil_sig(op.sig().type, fieldTypes),
+                        attrs={"stencil.program":UnitAttr()})
+        bvm = BlockAndValueMapping()
+        entry = func.addEntryBlock()
+        body = op.body().getBlock(0)
+        for field, obj in zip(entry.getArguments(), body.getArguments()):
+            bvm[obj] = field
+        copy_into(entry, body, bvm)
+        b.erase(op)
+        return True
+    return Pattern(py.func, patternFcn)
 
 def raiseStencilAssert(op, b):
     if not isa(op.func().definingOp, tmp.stencil_assert):
@@ -374,14 +426,15 @@ def raiseStencilStore(op, b):
 def raiseStencilApply(op, b):
     if not isa(op.func().definingOp, tmp.stencil_apply):
         return False
-    args = op.args()
-    # TODO more than one induction variable
-    assert len(args) == 2 and isa(args[1].definingOp, tmp.stencil_apply_body)
-    apply = b.create(stencil.apply, operands=[args[0]],
+    args = list(op.args())
+    # The temporaries are followed by the body function.
+    assert len(args) >= 2 and isa(args[-1].definingOp, tmp.stencil_apply_body)
+    temps = args[:-1]
+    apply = b.create(stencil.apply, operands=temps,
                      res=[tmp.unshaped_f64_temp()], loc=op.loc)
     bvm = BlockAndValueMapping()
-    entry = apply.region().addEntryBlock([tmp.unshaped_f64_temp()])
-    body = tmp.stencil_apply_body(args[1].definingOp).body().getBlock(0)
+    entry = apply.region().addEntryBlock([tmp.unshaped_f64_temp()] * len(temps))
+    body = tmp.stencil_apply_body(args[-1].definingOp).body().getBlock(0)
     for temp, obj in zip(entry.getArguments(), body.getArguments()):
         bvm[obj] = temp
     copy_into(entry, body, bvm)
@@ -395,8 +448,10 @@ def raiseStencilAccess(op, b):
     b.replace(op, [access.res()])
 
 def raiseStdConstant(op, b):
-    const = b.create(ConstantOp, value=F64Attr(op.value().getInt()),
-                     loc=op.loc)
+    value = op.value()
+    value = value.getValue() if isinstance(value, FloatAttr) else \
+        value.getInt()
+    const = b.create(ConstantOp, value=F64Attr(value), loc=op.loc)
     b.replace(op, [const.result()])
 
 def raiseStdUnary(op, b):
@@ -427,7 +482,7 @@ def raiseStdReturn(op, b):
     b.create(ReturnOp, operands=list(op.args()), loc=op.loc)
     b.erase(op)
 
-def raisePass(m):
+def raisePass(m, fieldTypes):
     applyOptPatterns(m, [
         Pattern(py.load, raiseStencilModule),
         raiseStencilFcn("cast", tmp.stencil_assert),
@@ -442,7 +497,7 @@ def raisePass(m):
     target.addIllegalDialect(str(py.name))
     target.addIllegalDialect(str(tmp.name))
     applyOptPatterns(m, [
-        Pattern(py.func, raiseStencilProgram),
+        raiseStencilProgram(fieldTypes),
         Pattern(py.call, raiseStencilAssert),
         Pattern(py.call, raiseStencilLoad),
         Pattern(py.call, raiseStencilApply),
@@ -458,27 +513,283 @@ def raisePass(m):
     ])
     applyPartialConversion(m, [], target)
 
+################################################################################
+# Element Types
+################################################################################
+
+# The raise pass builds every temporary and every computation in f64. Types
+# are assigned afterwards, in program order, once the whole program is in the
+# stencil dialect: loads take the type of their field, computations the widest
+# type of their operands, and an apply returns the type of the field it is
+# stored to, or else the widest type it reads. Constants take the type of the
+# values they are combined with. With an accumulator type, every computation
+# is done in at least that type.
+
+arith_ops = [AddFOp, SubFOp, MulFOp]
+
+def type_width(ty):
+    return 32 if ty == F32Type() else 64
+
+def widest(types, default):
+    return max(types, key=type_width, default=default)
+
+def convert_value(value, ty, before, b):
+    """`value` as type `ty`, converted right before the op `before`."""
+    if value.type == ty:
+        return value
+    b.insertBefore(before)
+    op = value.definingOp
+    if op and isa(op, ConstantOp):
+        attr = FloatAttr(ty, ConstantOp(op).value().getValue())
+        return b.create(ConstantOp, value=attr, loc=op.loc).result()
+    conv = FPExtOp if type_width(value.type) < type_width(ty) else FPTruncOp
+    return b.create(conv, source=value, type=ty, loc=before.loc).result()
+
+def apply_result_type(apply):
+    stored = set(grid_element_type(stencil.store(use).field().type)
+                 for res in apply.res() for use in users(res)
+                 if isa(use, stencil.store))
+    assert len(stored) <= 1, "temporary stored to fields of different types"
+    if stored:
+        return stored.pop()
+    return widest([grid_element_type(v.type) for v in apply.operands()],
+                  F64Type())
+
+def type_apply(apply, accType, b):
+    body = applyBody(apply)
+    for arg, operand in zip(body.getArguments(), apply.operands()):
+        arg.type = operand.type
+    # Values computed from constants alone do not decide the type of the
+    # computations they take part in.
+    weak = set()
+    for op in list(body):
+        if isa(op, stencil.access):
+            access = stencil.access(op)
+            access.res().type = grid_element_type(access.temp().type)
+        elif isa(op, ConstantOp):
+            weak.add(op.getResult(0))
+        elif any(isa(op, arith) for arith in arith_ops):
+            operands = list(op.getOperands())
+            strong = [v.type for v in operands if v not in weak]
+            if accType:
+                strong.append(accType)
+            ty = widest(strong, operands[0].type)
+            for i, v in enumerate(operands):
+                op.setOperand(i, convert_value(v, ty, op, b))
+            op.getResult(0).type = ty
+            if all(v in weak for v in operands):
+                weak.add(op.getResult(0))
+        elif isa(op, stencil.Return):
+            ty = apply_result_type(apply)
+            for i, v in enumerate(op.getOperands()):
+                op.setOperand(i, convert_value(v, ty, op, b))
+            for res in apply.res():
+                res.type = temp_type(ty)
+
+def typePass(m, accType):
+    b = Builder()
+    for func in m.getOps(FuncOp):
+        for op in func.getBody().getBlock(0):
+            if isa(op, stencil.load):
+                load = stencil.load(op)
+                ty = grid_element_type(load.field().type)
+                load.res().type = temp_type(ty)
+            elif isa(op, stencil.apply):
+                type_apply(stencil.apply(op), accType, b)
+            elif isa(op, stencil.store):
+                store = stencil.store(op)
+                assert store.temp().type == temp_type(
+                    grid_element_type(store.field().type)), \
+                    "stored temporary and field element types differ"
+
+################################################################################
+# Stencil Fusion
+################################################################################
+
+# Cost per grid point, in arithmetic ops, of passing a temporary between two
+# applies: the producer writes it out and the consumer reads it back, which is
+# memory-bound work that fusion avoids. Fusing instead recomputes the producer
+# once for every offset the consumer accesses it at.
+TEMP_COST = 8
+
+def collectApplies(m):
+    applies = []
+    def collect(op):
+        if isa(op, stencil.apply):
+            applies.append(stencil.apply(op))
+    walkOperations(m, collect)
+    return applies
+
+def users(val):
+    """The distinct operations using `val`."""
+    return list({hash(op): op for op in val.getOpUses()}.values())
+
+def applyBody(apply):
+    return apply.region().getBlock(0)
+
+def bodyCost(apply):
+    return sum(1 for op in applyBody(apply)
+               if not (isa(op, stencil.access) or isa(op, stencil.Return) or
+                       isa(op, ConstantOp)))
+
+def accessedOffsets(apply, temp):
+    """The distinct offsets at which `apply` accesses the operand `temp`."""
+    body = applyBody(apply)
+    args = [arg for arg, operand in zip(body.getArguments(), apply.operands())
+            if operand == temp]
+    offsets = set()
+    for op in body:
+        if isa(op, stencil.access) and stencil.access(op).temp() in args:
+            offsets.add(tuple(v.getInt() for v in stencil.access(op).offset()))
+    return offsets
+
+def fusionCost(producer):
+    """Extra arithmetic per grid point of fusing `producer` into all of its
+    consumers, or None if it cannot be fused."""
+    if len(producer.res()) != 1 or producer.lb():
+        return None
+    temp = producer.res()[0]
+    consumers = users(temp)
+    if not consumers:
+        return None
+    recompute = 0
+    for consumer in consumers:
+        if not isa(consumer, stencil.apply):
+            # Stored or otherwise used: the temporary stays either way.
+            return None
+        consumer = stencil.apply(consumer)
+        if consumer.lb():
+            return None
+        recompute += len(accessedOffsets(consumer, temp))
+    # The first evaluation is needed anyway, fused or not.
+    return (recompute - 1) * bodyCost(producer)
+
+def fuseInto(producer, consumer, b):
+    """Replace `consumer` with an apply that evaluates `producer` inline at
+    every offset the consumer accesses its result at."""
+    temp = producer.res()[0]
+    operands = [v for v in consumer.operands() if v != temp]
+    operands += [v for v in producer.operands() if v not in operands]
+
+    b.insertBefore(consumer)
+    fused = b.create(stencil.apply, operands=operands,
+                     res=[r.type for r in consumer.res()], loc=consumer.loc)
+    entry = fused.region().addEntryBlock([v.type for v in operands])
+    argFor = dict(zip(operands, entry.getArguments()))
+    b.insertAtEnd(entry)
+
+    def cloneInto(op, bvm, values):
+        new = op.clone(bvm)
+        entry.append(new)
+        values.update(zip(op.getResults(), new.getResults()))
+
+    evaluated = {}
+    def producerAt(offset):
+        if offset in evaluated:
+            return evaluated[offset]
+        bvm = BlockAndValueMapping()
+        values = {}
+        for arg, operand in zip(applyBody(producer).getArguments(),
+                                producer.operands()):
+            bvm[arg] = argFor[operand]
+            values[arg] = argFor[operand]
+        for op in applyBody(producer):
+            if isa(op, stencil.access):
+                access = stencil.access(op)
+                shifted = [v.getInt() + o
+                           for v, o in zip(access.offset(), offset)]
+                res = b.create(stencil.access, temp=values[access.temp()],
+                               offset=I64ArrayAttr(shifted),
+                               res=access.res().type, loc=op.loc).res()
+                bvm[access.res()] = res
+                values[access.res()] = res
+            elif isa(op, stencil.Return):
+                evaluated[offset] = values[stencil.Return(op).operands()[0]]
+            else:
+                cloneInto(op, bvm, values)
+        return evaluated[offset]
+
+    bvm = BlockAndValueMapping()
+    body = applyBody(consumer)
+    tempArgs = []
+    for arg, operand in zip(body.getArguments(), consumer.operands()):
+        if operand == temp:
+            tempArgs.append(arg)
+        else:
+            bvm[arg] = argFor[operand]
+    for op in body:
+        if isa(op, stencil.access) and stencil.access(op).temp() in tempArgs:
+            access = stencil.access(op)
+            bvm[access.res()] = producerAt(
+                tuple(v.getInt() for v in access.offset()))
+        else:
+            cloneInto(op, bvm, {})
+    b.replace(consumer, fused.res())
+
+def fusionPass(m):
+    """Greedily fuse producer applies into their consumers while the extra
+    recomputation costs less than materializing the temporary."""
+    b = Builder()
+    while True:
+        candidates = []
+        for producer in collectApplies(m):
+            cost = fusionCost(producer)
+            if cost is not None and cost <= TEMP_COST:
+                candidates.append((cost, producer))
+        if not candidates:
+            return
+        # Cheapest first; fusing changes the costs of the others, so fuse one
+        # producer per round and look again.
+        cost, producer = min(candidates, key=lambda c: c[0])
+        for consumer in users(producer.res()[0]):
+            fuseInto(producer, stencil.apply(consumer), b)
+        b.erase(producer)
+
 ################################################################################
 # Public API
 ################################################################################
 
-cache = cwd + "/__pycache__"
+cache = os.environ.get("OEC_CACHE_DIR", cwd + "/__pycache__")
 try:
     os.makedirs(cache)
 except OSError as e:
     pass
 
-def raise_function(func):
-    import inspect
+# Compiled kernels are cached by content, so bump this whenever the binding
+# ABI or the cache layout changes to stop old kernels from being picked up.
+CACHE_VERSION = 3
+cache_stats = {"hits": 0, "misses": 0}
 
-    node = ast.parse(inspect.getsource(func))
-    m = StencilProgramVisitor().visit(node)
+def cache_info():
+    return dict(cache_stats)
+
+if os.environ.get("OEC_CACHE_STATS"):
+    import atexit
+    import sys
+    atexit.register(lambda: print(
+        "oec cache: {hits} hits, {misses} misses".format(**cache_stats),
+        file=sys.stderr))
+
+def use_fusion():
+    return os.environ.get("OEC_FUSION", "1") != "0"
+
+def raise_source(source, accumulate=None):
+    node = ast.parse(source)
+    visitor = StencilProgramVisitor()
+    m = visitor.visit(node)
     varAllocPass(m)
-    raisePass(m)
+    raisePass(m, visitor.fieldTypes)
+    typePass(m, accumulate and dtype_element_type(accumulate))
+    if use_fusion():
+        fusionPass(m)
     if not verify(m):
         return None
     return m
 
+def raise_function(func, accumulate=None):
+    import inspect
+    return raise_source(inspect.getsource(func), accumulate)
+
 oec_compile_args = [
     "oec-opt", "--stencil-shape-inference", "--convert-stencil-to-std",
     "--cse", "--parallel-loop-tiling=parallel-loop-tile-sizes=128,1,1",
@@ -486,50 +797,325 @@ oec_compile_args = [
     "--convert-parallel-loops-to-gpu", "--canonicalize", "--lower-affine",
     "--convert-scf-to-std", "--stencil-kernel-to-cubin"]
 
+# The CPU pipeline tiles the middle and innermost dimensions for cache and
+# leaves the innermost tile contiguous and constant-sized for the LLVM loop
+# vectorizer. The outermost dimension is split across threads by the binding.
+oec_cpu_tile_sizes = "1,8,64"
+oec_cpu_compile_args = [
+    "oec-opt", "--stencil-shape-inference", "--convert-stencil-to-std",
+    "--cse",
+    "--parallel-loop-tiling=parallel-loop-tile-sizes=" + oec_cpu_tile_sizes,
+    "--canonicalize", "--lower-affine", "--convert-scf-to-std",
+    "--convert-std-to-llvm=emit-c-wrappers=1"]
+
+def default_target():
+    target = os.environ.get("OEC_TARGET")
+    if target:
+        assert target in ("cuda", "cpu"), "unknown OEC_TARGET: " + target
+        return target
+    import dl_stencil
+    return "cuda" if dl_stencil.has_cuda else "cpu"
+
+def num_threads():
+    threads = os.environ.get("OMP_NUM_THREADS")
+    return int(threads) if threads else os.cpu_count() or 1
+
+def choose_chunks(extent, threads):
+    # Prefer a multiple of the thread count so every thread gets the same
+    # number of rows, then any split with at least one chunk per thread.
+    divisors = [d for d in range(1, extent + 1) if extent % d == 0]
+    for d in divisors:
+        if d >= threads and d % threads == 0:
+            return d
+    for d in divisors:
+        if d >= threads:
+            return d
+    return extent
+
+def collectStores(m):
+    stores = []
+    def collect(op):
+        if isa(op, stencil.store):
+            stores.append(stencil.store(op))
+    walkOperations(m, collect)
+    return stores
+
+def collectAsserts(m):
+    asserts = []
+    def collect(op):
+        if isa(op, stencil.Assert):
+            asserts.append(stencil.Assert(op))
+    walkOperations(m, collect)
+    return asserts
+
+def fieldSignature(m):
+    """Return the element types of the fields of the stencil program, as
+    "f32" or "f64", the indices of those it stores to, and the shape each
+    field is asserted to have."""
+    funcs = list(m.getOps(FuncOp))
+    assert len(funcs) == 1, "expected a single stencil program"
+    fields = list(funcs[0].getBody().getBlock(0).getArguments())
+    outputs = set()
+    for store in collectStores(m):
+        outputs.add(next(i for i, field in enumerate(fields)
+                         if field == store.field()))
+    types = ["f32" if grid_element_type(field.type) == F32Type() else "f64"
+             for field in fields]
+    shapes = [None] * len(fields)
+    for op in collectAsserts(m):
+        idx = next(i for i, field in enumerate(fields) if field == op.field())
+        shapes[idx] = [op.ub()[i].getInt() - op.lb()[i].getInt()
+                       for i in range(3)]
+    assert all(shapes), "every field needs a stencil.assert of its bounds"
+    return types, sorted(outputs), shapes
+
+def splitOuterDim(m, threads):
+    """Shrink the outermost store range to one chunk of rows.
+
+    The binding runs the kernel once per chunk with every field shifted by a
+    multiple of the chunk, so all stores must cover the same outer range.
+    Returns the number of chunks and the rows per chunk."""
+    stores = collectStores(m)
+    assert stores, "stencil program has no store"
+    ranges = set((s.lb()[0].getInt(), s.ub()[0].getInt()) for s in stores)
+    assert len(ranges) == 1, "stores must cover the same outermost range"
+    lb, ub = ranges.pop()
+    chunks = choose_chunks(ub - lb, threads)
+    rows = (ub - lb) // chunks
+    for store in stores:
+        bound = [v.getInt() for v in store.ub()]
+        bound[0] = lb + rows
+        store.setAttr("ub", I64ArrayAttr(bound))
+    return chunks, rows
+
+# Seconds each toolchain step may take; clang -O3 on a large kernel can be slow.
+tool_timeout = float(os.environ.get("OEC_TOOL_TIMEOUT", 120))
+
 def wait_proc(args):
     import subprocess
 
     proc = subprocess.Popen(args, stderr=subprocess.PIPE)
     try:
-        outs, errs = proc.communicate(timeout=5)
+        outs, errs = proc.communicate(timeout=tool_timeout)
         if proc.returncode != 0:
             print(errs)
             return False
-    except TimeoutExpired:
+    except subprocess.TimeoutExpired:
         proc.kill()
-        print(args[0], "call failed")
+        print(args[0], "call timed out")
         return False
     return True
 
-def compile_function(name, m):
-    prefix = cache + '/' + name
+def tool_identity(tool):
+    # Identify the toolchain by its binaries rather than by running them, so
+    # that a cache hit spawns no processes at all.
+    import shutil
+    path = tool if os.path.isabs(tool) else shutil.which(tool)
+    if not path or not os.path.exists(path):
+        return tool
+    path = os.path.realpath(path)
+    st = os.stat(path)
+    return "{}:{}:{}".format(path, st.st_size, st.st_mtime_ns)
+
+def host_identity():
+    # CPU kernels are built with -march=native, so a cache shared between
+    # machines must not mix kernels built for different processors.
+    import platform
+    model = ""
+    try:
+        with open("/proc/cpuinfo") as f:
+            model = next((line for line in f if line.startswith("model name")),
+                         "")
+    except OSError:
+        pass
+    return platform.machine() + ":" + model.strip()
+
+def kernel_key(m, target, pipeline, renames):
+    import hashlib
+    key = hashlib.sha256()
+    parts = [str(CACHE_VERSION), target, host_identity(), str(m),
+             str(sorted(renames.items()))]
+    for args in pipeline:
+        parts.append(tool_identity(args[0]))
+        parts.append(" ".join(args))
+    for part in parts:
+        key.update(part.encode())
+        key.update(b"\0")
+    return key.hexdigest()
+
+translate_args = ["mlir-translate", "--mlir-to-llvmir"]
+
+def rename_symbols(filename, renames):
+    import re
+    with open(filename) as f:
+        text = f.read()
+    for old, new in renames.items():
+        text = re.sub(r"@" + re.escape(old) + r"\b", "@" + new, text)
+    with open(filename, 'w') as f:
+        f.write(text)
+
+def build_kernel(name, m, target, compile_args, link_args, renames={}):
+    """Compile the raised module to a shared library, or return the cached
+    one built from the same module, pipeline, toolchain and target. Functions
+    the lowered module calls are renamed according to `renames`."""
+    key = kernel_key(m, target, [compile_args, translate_args, link_args],
+                     renames)
+    prefix = cache + '/' + name + '.' + target + '.' + key[:16]
+    so_file = prefix + '.so'
+    if os.path.exists(so_file):
+        cache_stats["hits"] += 1
+        return so_file
+    cache_stats["misses"] += 1
+
     in_file = prefix + '.mlir'
     with open(in_file, 'w') as f:
         f.write(str(m))
 
     lower_file = prefix + '.lowered.mlir'
-    args = list(oec_compile_args) + [in_file, "-o", lower_file]
+    args = list(compile_args) + [in_file, "-o", lower_file]
     if not wait_proc(args):
         return None
+    if renames:
+        rename_symbols(lower_file, renames)
 
     ll_file = prefix + '.ll'
-    args = ["mlir-translate", "--mlir-to-llvmir", lower_file, "-o", ll_file]
+    args = translate_args + [lower_file, "-o", ll_file]
     if not wait_proc(args):
         return None
 
-    so_file = prefix + '.so'
-    args = ["clang", "-O3", ll_file, "-shared", "-l", "cuda-runtime-wrappers",
-            "-L", os.environ["LD_LIBRARY_PATH"], "-o", so_file]
+    # Publish the library atomically so that a concurrent or interrupted
+    # build never leaves a truncated kernel under the final name.
+    tmp_file = "{}.{}.tmp.so".format(prefix, os.getpid())
+    args = list(link_args) + [ll_file, "-o", tmp_file]
     if not wait_proc(args):
         return None
+    os.replace(tmp_file, so_file)
+    return so_file
+
+def compile_function(name, m):
+    link_args = ["clang", "-O3", "-shared", "-l", "cuda-runtime-wrappers",
+                 "-L", os.environ["LD_LIBRARY_PATH"]]
+    so_file = build_kernel(name, m, "cuda", oec_compile_args, link_args)
+    if not so_file:
+        return None
 
     import dl_stencil
     dl_stencil.cuda_init()
-    return dl_stencil.bind_stencil(name, so_file)
+    fcn = dl_stencil.load_stencil(name, so_file)
+    if not fcn:
+        return None
+    return dl_stencil.bind_stencil(fcn, *fieldSignature(m))
+
+def pass_pipeline(compile_args):
+    """Spell oec-opt command line flags as a textual pass pipeline."""
+    passes = []
+    for arg in compile_args[1:]:
+        name, _, options = arg[2:].partition("=")
+        passes.append(name + ("{" + options + "}" if options else ""))
+    return ",".join(passes)
+
+def use_jit():
+    if os.environ.get("OEC_JIT", "1") == "0":
+        return False
+    try:
+        import jit_stencil
+    except ImportError:
+        return False
+    return True
+
+# CPU kernels allocate their temporaries from the buffer pool in dl_stencil,
+# so that repeated calls reuse them instead of going through malloc each time.
+pool_symbols = {"malloc": "oec_pool_alloc", "free": "oec_pool_free"}
+
+def use_pool():
+    return os.environ.get("OEC_POOL", "1") != "0"
+
+def jit_kernel(name, m, compile_args, renames={}):
+    """JIT the raised module in-process and return the address of its packed
+    entry point. The object code is cached like build_kernel's libraries, keyed
+    on the module, the pipeline and the jit_stencil build, so a cache hit only
+    loads it."""
+    import jit_stencil
+    pipeline = pass_pipeline(compile_args)
+    key = kernel_key(m, "cpu-jit", [[jit_stencil.__file__, pipeline]], renames)
+    prefix = cache + '/' + name + '.cpu-jit.' + key[:16]
+    obj_file = prefix + '.o'
+    if os.path.exists(obj_file):
+        cache_stats["hits"] += 1
+        return jit_stencil.load(obj_file, name)
+    cache_stats["misses"] += 1
+
+    # The module only changes contexts once, in memory: the stencil ops built
+    # here belong to the dynamic dialect, so they are printed and parsed into
+    # the compiler's context with the real stencil dialect.
+    tmp_file = "{}.{}.tmp.o".format(prefix, os.getpid())
+    addr, _ = jit_stencil.compile(str(m), pipeline, name, renames=renames,
+                                  object_file=tmp_file)
+    if os.path.exists(tmp_file):
+        os.replace(tmp_file, obj_file)
+    return addr
+
+def compile_function_cpu(name, m):
+    chunks, rows = splitOuterDim(m, num_threads())
+    import dl_stencil
+    if use_jit():
+        addr = jit_kernel(name, m, oec_cpu_compile_args,
+                          pool_symbols if use_pool() else {})
+        fcn = dl_stencil.packed_stencil(addr)
+    else:
+        link_args = ["clang", "-O3", "-march=native", "-ffp-contract=fast",
+                     "-fPIC", "-shared"]
+        so_file = build_kernel(name, m, "cpu", oec_cpu_compile_args, link_args,
+                               pool_symbols if use_pool() else {})
+        if not so_file:
+            return None
+        fcn = dl_stencil.load_stencil(name, so_file)
+        if not fcn:
+            return None
+    return dl_stencil.bind_cpu_stencil(fcn, *fieldSignature(m), chunks, rows)
+
+def empty(shape, halo, dtype):
+    """An uninitialized field of `shape` including a halo of `halo` points,
+    from the buffer pool. The first interior point is aligned, and the buffer
+    is reused by the next field of the same layout once this one is freed."""
+    import dl_stencil
+    import numpy as np
+    return dl_stencil.pool_array(shape, halo, np.dtype(dtype))
+
+def pool_stats():
+    """Allocation statistics of the buffer pool shared by all stencils."""
+    import dl_stencil
+    return dl_stencil.pool_stats()
 
 # Python automatically caches annotations
-def program(func):
-    m = raise_function(func)
+def program(func=None, accumulate=None):
+    """Compile a stencil program. Fields are f64 unless annotated with another
+    dtype, e.g. `a: np.float32`. With `accumulate`, e.g. np.float64, all
+    arithmetic is done in at least that type, whatever the fields are stored
+    as. Usable as `@program` or `@program(accumulate=...)`."""
+    if func == None:
+        return lambda func: program(func, accumulate)
+    return compile_program(func.__qualname__,
+                           lambda: raise_function(func, accumulate))
+
+def program_source(source, accumulate=None):
+    """Compile the stencil program defined in `source`, for programs that are
+    generated at run time, e.g. for a given grid size."""
+    name = ast.parse(source).body[0].name
+    return compile_program(name, lambda: raise_source(source, accumulate))
+
+def compile_program(name, raise_fcn):
+    import time
+    start = time.perf_counter()
+    m = raise_fcn()
     if not m:
         return None
-    return compile_function(func.__qualname__, m)
+    if default_target() == "cpu":
+        ret = compile_function_cpu(name, m)
+    else:
+        ret = compile_function(name, m)
+    if os.environ.get("OEC_COMPILE_TIMES"):
+        import sys
+        print("oec: compiled {} in {:.1f} ms".format(
+              name, 1000 * (time.perf_counter() - start)), file=sys.stderr)
+    return ret